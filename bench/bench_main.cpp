@@ -0,0 +1,333 @@
+// bench_main.cpp
+// 扫描与传输热点路径的基准测试，结果输出为JSON。
+// copy_stream和TCP探测部分不需要Samba；list_shares和传输部分需要
+// bench/start_smbd_instances.sh启动的本地实例(端口4455-4464，共享Shared_1..Shared_10)
+#include "discovery.hpp"
+#include "samba_client.hpp"
+#include "transfer.hpp"
+#include <json/json.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct BenchOptions {
+    string host = "127.0.0.1";
+    vector<int> ports;             // 为空时使用4455-4464
+    string share_prefix = "Shared_";
+    SmbCredentials credentials;
+    string out;                    // 为空时输出到stdout
+    bool smb = true;               // 是否跑需要smbd的部分
+    bool quick = false;            // 缩小规模，用于快速回归
+    int repeat = 20;               // list_shares重复次数
+};
+
+double ms_since(Clock::time_point t0) {
+    return chrono::duration<double, milli>(Clock::now() - t0).count();
+}
+
+// 排序后取p50/p95/max/mean
+Json::Value summarize(vector<double> samples) {
+    Json::Value v;
+    if (samples.empty()) return v;
+    sort(samples.begin(), samples.end());
+    auto at = [&](double q) { return samples[min(samples.size() - 1, size_t(q * samples.size()))]; };
+    double sum = 0;
+    for (double s : samples) sum += s;
+    v["n"] = Json::UInt64(samples.size());
+    v["p50_ms"] = at(0.50);
+    v["p95_ms"] = at(0.95);
+    v["max_ms"] = samples.back();
+    v["mean_ms"] = sum / samples.size();
+    return v;
+}
+
+// 进程内的假后端：内存到内存，latency_us模拟每次SMB往返
+Json::Value bench_copy_stream(const BenchOptions& opts) {
+    Json::Value results(Json::arrayValue);
+    vector<size_t> sizes = opts.quick ? vector<size_t>{1 << 20, 16 << 20}
+                                      : vector<size_t>{1 << 20, 16 << 20, 128 << 20};
+    vector<size_t> chunks = {64 << 10, 256 << 10, 1 << 20, 4 << 20};
+    vector<int> latencies = {0, 200};
+
+    for (size_t size : sizes) {
+        vector<char> src(size, 'x');
+        vector<char> dst(size);
+        for (size_t chunk : chunks) {
+            for (int latency : latencies) {
+                for (bool pipelined : {false, true}) {
+                    size_t rpos = 0, wpos = 0;
+                    ChunkReader reader = [&](char* buf, size_t len) -> ssize_t {
+                        if (latency) this_thread::sleep_for(chrono::microseconds(latency));
+                        size_t n = min(len, size - rpos);
+                        memcpy(buf, src.data() + rpos, n);
+                        rpos += n;
+                        return n;
+                    };
+                    ChunkWriter writer = [&](const char* buf, size_t len) -> ssize_t {
+                        memcpy(dst.data() + wpos, buf, len);
+                        wpos += len;
+                        return len;
+                    };
+
+                    TransferOptions options;
+                    options.chunk_size = chunk;
+                    options.pipelined = pipelined;
+                    TransferStats stats;
+                    bool ok = copy_stream(reader, writer, options, stats);
+
+                    Json::Value r;
+                    r["file_size"] = Json::UInt64(size);
+                    r["chunk_size"] = Json::UInt64(chunk);
+                    r["latency_us"] = latency;
+                    r["pipelined"] = pipelined;
+                    r["ok"] = ok && wpos == size;
+                    r["seconds"] = stats.seconds;
+                    r["mib_per_sec"] = stats.bytes_per_sec() / (1024 * 1024);
+                    results.append(r);
+                }
+            }
+        }
+    }
+    return results;
+}
+
+// TCP探测延迟随主机数和端口数的变化；127.0.0.0/8都指向本机，关闭的端口立即RST
+Json::Value bench_scan(const BenchOptions& opts) {
+    Json::Value results(Json::arrayValue);
+    vector<size_t> host_counts = opts.quick ? vector<size_t>{1, 16, 256}
+                                            : vector<size_t>{1, 16, 256, 4096};
+    vector<vector<int>> port_sets = {{445}, DiscoveryEngine::default_ports()};
+    DiscoveryOptions discovery;
+
+    for (size_t hosts : host_counts) {
+        for (const auto& ports : port_sets) {
+            vector<ProbeTarget> targets;
+            for (size_t h = 0; h < hosts; ++h) {
+                string ip = "127.0." + to_string((h + 1) / 256) + "." + to_string((h + 1) % 256);
+                for (int port : ports) {
+                    targets.push_back({ip, port});
+                }
+            }
+
+            auto t0 = Clock::now();
+            auto open = probe_tcp(targets, discovery.connect_timeout_ms, discovery.max_inflight);
+            double elapsed = ms_since(t0);
+
+            Json::Value r;
+            r["hosts"] = Json::UInt64(hosts);
+            r["ports"] = Json::UInt64(ports.size());
+            r["targets"] = Json::UInt64(targets.size());
+            r["open"] = Json::UInt64(open.size());
+            r["probe_ms"] = elapsed;
+            r["targets_per_sec"] = elapsed > 0 ? targets.size() * 1000.0 / elapsed : 0;
+            results.append(r);
+        }
+    }
+    return results;
+}
+
+// 完整发现流程(探测+握手+列共享)在本地实例上的耗时
+Json::Value bench_discover(const BenchOptions& opts, const shared_ptr<SmbContextPool>& pool) {
+    DiscoveryEngine engine(DiscoveryOptions(), pool);
+    auto t0 = Clock::now();
+    auto services = engine.discover(vector<string>{opts.host}, opts.ports);
+    double elapsed = ms_since(t0);
+
+    Json::Value r;
+    r["ports"] = Json::UInt64(opts.ports.size());
+    r["services"] = Json::UInt64(services.size());
+    r["total_ms"] = elapsed;
+    r["probe_ms"] = engine.stats().probe_ms;
+    r["smb_ms"] = engine.stats().smb_ms;
+    return r;
+}
+
+// 冷启动(每次新建池，包含连接和认证)与热池(复用已认证上下文)两种情况
+Json::Value bench_list_shares(const BenchOptions& opts, const shared_ptr<SmbContextPool>& pool) {
+    Json::Value results(Json::arrayValue);
+    for (int port : opts.ports) {
+        vector<double> cold, warm;
+        size_t shares = 0;
+        for (int i = 0; i < opts.repeat; ++i) {
+            SambaClient fresh(make_shared<SmbContextPool>(opts.credentials));
+            auto t0 = Clock::now();
+            shares = fresh.list_shares(opts.host, port).size();
+            cold.push_back(ms_since(t0));
+        }
+        SambaClient client(pool);
+        client.list_shares(opts.host, port);
+        for (int i = 0; i < opts.repeat; ++i) {
+            auto t0 = Clock::now();
+            client.list_shares(opts.host, port);
+            warm.push_back(ms_since(t0));
+        }
+
+        Json::Value r;
+        r["port"] = port;
+        r["shares"] = Json::UInt64(shares);
+        r["cold"] = summarize(cold);
+        r["warm"] = summarize(warm);
+        results.append(r);
+    }
+    return results;
+}
+
+bool write_random_file(const string& path, size_t size) {
+    ofstream out(path, ios::binary | ios::trunc);
+    mt19937_64 rng(size);
+    vector<uint64_t> block(8192);
+    for (size_t written = 0; written < size && out;) {
+        for (auto& w : block) w = rng();
+        size_t n = min(size - written, block.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(block.data()), n);
+        written += n;
+    }
+    return bool(out);
+}
+
+// 对第一个可用实例做上传/下载，覆盖不同文件大小和块大小
+Json::Value bench_transfer(const BenchOptions& opts, const shared_ptr<SmbContextPool>& pool,
+                           int port, const string& share, const string& tmpdir) {
+    Json::Value results(Json::arrayValue);
+    vector<size_t> sizes = opts.quick ? vector<size_t>{64 << 10, 1 << 20, 16 << 20}
+                                      : vector<size_t>{64 << 10, 1 << 20, 16 << 20, 256 << 20};
+    vector<size_t> chunks = {64 << 10, 1 << 20, 4 << 20, 16 << 20};
+    SambaClient client(pool);
+
+    for (size_t size : sizes) {
+        string local = tmpdir + "/src_" + to_string(size);
+        string back = tmpdir + "/dst_" + to_string(size);
+        string remote = "pcn_bench_" + to_string(size) + ".bin";
+        if (!write_random_file(local, size)) continue;
+
+        for (size_t chunk : chunks) {
+            TransferOptions options;
+            options.chunk_size = chunk;
+            client.set_transfer_options(options);
+
+            Json::Value r;
+            r["file_size"] = Json::UInt64(size);
+            r["chunk_size"] = Json::UInt64(chunk);
+            r["upload_ok"] = client.upload(opts.host, share, local, remote, port);
+            r["upload_mib_per_sec"] = client.last_transfer().bytes_per_sec() / (1024 * 1024);
+            r["download_ok"] = client.download(opts.host, share, remote, back, port);
+            r["download_mib_per_sec"] = client.last_transfer().bytes_per_sec() / (1024 * 1024);
+            results.append(r);
+        }
+        client.remove_remote(opts.host, share, remote, port);
+        unlink(local.c_str());
+        unlink(back.c_str());
+    }
+    return results;
+}
+
+void print_usage(const char* prog) {
+    cerr << "用法: " << prog << " [--out results.json] [--host 127.0.0.1] [--ports 4455-4464]\n"
+         << "      [--user 用户名] [--password 密码] [--repeat N] [--quick] [--no-smb]\n";
+}
+
+// "4455-4464" 或 "445,4455"
+vector<int> parse_ports(const string& spec) {
+    vector<int> ports;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        string item = spec.substr(pos, end == string::npos ? string::npos : end - pos);
+        size_t dash = item.find('-');
+        int first = stoi(item.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(item.substr(dash + 1));
+        for (int p = first; p <= last; ++p) ports.push_back(p);
+        if (end == string::npos) break;
+        pos = end + 1;
+    }
+    return ports;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions opts;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--out" && has_value) {
+                opts.out = argv[++i];
+            } else if (arg == "--host" && has_value) {
+                opts.host = argv[++i];
+            } else if (arg == "--ports" && has_value) {
+                opts.ports = parse_ports(argv[++i]);
+            } else if (arg == "--user" && has_value) {
+                opts.credentials.username = argv[++i];
+            } else if (arg == "--password" && has_value) {
+                opts.credentials.password = argv[++i];
+            } else if (arg == "--repeat" && has_value) {
+                opts.repeat = max(1, stoi(argv[++i]));
+            } else if (arg == "--quick") {
+                opts.quick = true;
+            } else if (arg == "--no-smb") {
+                opts.smb = false;
+            } else {
+                print_usage(argv[0]);
+                return arg == "-h" || arg == "--help" ? 0 : 2;
+            }
+        }
+        if (opts.ports.empty()) {
+            for (int p = 4455; p <= 4464; ++p) opts.ports.push_back(p);
+        }
+
+        Json::Value root;
+        root["host"] = opts.host;
+        root["quick"] = opts.quick;
+        root["copy_stream"] = bench_copy_stream(opts);
+        root["scan"] = bench_scan(opts);
+
+        if (opts.smb) {
+            auto pool = make_shared<SmbContextPool>(opts.credentials);
+            root["discover"] = bench_discover(opts, pool);
+            root["list_shares"] = bench_list_shares(opts, pool);
+
+            // 传输只在第一个列出共享的实例上做，共享名按端口对应Shared_N
+            char tmpl[] = "/tmp/pcn_bench.XXXXXX";
+            if (!mkdtemp(tmpl)) {
+                throw runtime_error("Failed to create temp dir");
+            }
+            SambaClient client(pool);
+            for (size_t i = 0; i < opts.ports.size(); ++i) {
+                string share = opts.share_prefix + to_string(i + 1);
+                if (client.check_samba(opts.host, opts.ports[i])) {
+                    root["transfer"] = bench_transfer(opts, pool, opts.ports[i], share, tmpl);
+                    root["transfer_target"] = opts.host + ":" + to_string(opts.ports[i]) + "/" + share;
+                    break;
+                }
+            }
+            rmdir(tmpl);
+        }
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        string json = Json::writeString(builder, root) + "\n";
+        if (opts.out.empty()) {
+            cout << json;
+        } else {
+            ofstream(opts.out) << json;
+        }
+    } catch (const exception& e) {
+        cerr << "错误: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/bash
+# 基准测试用的本地Samba实例：不需要root，所有状态放在临时目录
+# 用法: bench/start_smbd_instances.sh [实例数]   启动，输出临时目录
+#       bench/start_smbd_instances.sh stop <临时目录>
+# 实例i监听4454+i端口，共享名Shared_i；未知用户映射为guest(即当前用户)，
+# 因此默认凭据也能连接
+
+set -e
+
+if [ "$1" = "stop" ]; then
+  DIR="$2"
+  [ -d "$DIR" ] || { echo "用法: $0 stop <临时目录>" >&2; exit 2; }
+  for pid in "$DIR"/instance_*/pid/smbd*.pid; do
+    [ -f "$pid" ] && kill "$(cat "$pid")" 2>/dev/null || true
+  done
+  rm -rf "$DIR"
+  exit 0
+fi
+
+COUNT=${1:-10}
+SMBD=$(command -v smbd || echo /usr/sbin/smbd)
+[ -x "$SMBD" ] || { echo "未找到smbd" >&2; exit 1; }
+
+DIR=$(mktemp -d /tmp/pcn_smbd.XXXXXX)
+ME=$(id -un)
+
+for i in $(seq 1 "$COUNT"); do
+  PORT=$((4454 + i))
+  INST="$DIR/instance_$i"
+  mkdir -p "$INST"/{share,pid,lock,private,state,cache,log}
+
+  cat > "$INST/smb.conf" <<EOF
+[global]
+    netbios name = PCN_BENCH_$i
+    workgroup = WORKGROUP
+    smb ports = $PORT
+    interfaces = lo
+    bind interfaces only = yes
+    disable netbios = yes
+    security = user
+    map to guest = bad user
+    guest account = $ME
+    passdb backend = tdbsam:$INST/private/passdb.tdb
+    pid directory = $INST/pid
+    lock directory = $INST/lock
+    private dir = $INST/private
+    state directory = $INST/state
+    cache directory = $INST/cache
+    ncalrpc dir = $INST/state/ncalrpc
+    log file = $INST/log/smbd.log
+    log level = 0
+    load printers = no
+    printcap name = /dev/null
+    use sendfile = yes
+
+[Shared_$i]
+    path = $INST/share
+    read only = no
+    guest ok = yes
+    browseable = yes
+EOF
+
+  "$SMBD" -D -s "$INST/smb.conf"
+done
+
+# 等待端口就绪
+for i in $(seq 1 "$COUNT"); do
+  PORT=$((4454 + i))
+  for _ in $(seq 1 50); do
+    (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null && break
+    sleep 0.1
+  done
+done
+
+echo "$DIR"
@@ -0,0 +1,98 @@
+// async_client.hpp
+#pragma once
+#include "samba_client.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 固定数量工作线程的执行器，任务按提交顺序取出；析构时执行完队列中的任务再退出
+class Executor {
+public:
+    explicit Executor(size_t threads);
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void post(std::function<void()> task);
+    // 排队中、尚未开始的任务数
+    size_t pending() const;
+
+private:
+    void worker();
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+// 异步传输的结果，error为errno(取消/超时为ECANCELED/ETIMEDOUT)
+struct AsyncStatus {
+    bool ok = false;
+    int error = 0;
+    TransferStats stats;
+};
+
+using Completion = std::function<void(const AsyncStatus&)>;
+
+struct AsyncOptions {
+    size_t workers = 16;  // 同时执行的操作数，其余排队；每台服务器还受连接池max_per_key限制
+};
+
+// SambaClient的异步版本：操作提交到内部执行器，立即返回future或在完成时回调。
+// 每个操作使用独立的SambaClient，共享同一个连接池；
+// TransferControl在排队、等待连接池上下文时和传输的块之间检查，截止时间同时收紧单个SMB请求的超时
+class AsyncSambaClient {
+public:
+    explicit AsyncSambaClient(std::shared_ptr<SmbContextPool> pool = nullptr,
+                              const AsyncOptions& options = AsyncOptions());
+
+    const std::shared_ptr<SmbContextPool>& context_pool() const { return pool_; }
+    void set_transfer_options(const TransferOptions& options);
+
+    std::future<AsyncStatus> download_async(const std::string& ip, const std::string& share,
+                                            const std::string& remote_path,
+                                            const std::string& local_path, int port = 445,
+                                            const TransferControl& control = TransferControl());
+    std::future<AsyncStatus> upload_async(const std::string& ip, const std::string& share,
+                                          const std::string& local_path,
+                                          const std::string& remote_path, int port = 445,
+                                          const TransferControl& control = TransferControl());
+
+    // 回调版本：done在执行器线程中调用
+    void download_async(const std::string& ip, const std::string& share,
+                        const std::string& remote_path, const std::string& local_path,
+                        Completion done, int port = 445,
+                        const TransferControl& control = TransferControl());
+    void upload_async(const std::string& ip, const std::string& share,
+                      const std::string& local_path, const std::string& remote_path,
+                      Completion done, int port = 445,
+                      const TransferControl& control = TransferControl());
+
+    std::future<bool> check_samba_async(const std::string& ip, int port = 445,
+                                        const TransferControl& control = TransferControl());
+    std::future<std::vector<SambaShare>> list_shares_async(
+        const std::string& ip, int port = 445, const TransferControl& control = TransferControl());
+
+    size_t pending() const { return executor_.pending(); }
+
+private:
+    using Operation = std::function<bool(SambaClient&)>;
+
+    void run(const TransferControl& control, Completion done, Operation op);
+    std::future<AsyncStatus> run(const TransferControl& control, Operation op);
+
+    std::shared_ptr<SmbContextPool> pool_;
+    TransferOptions transfer_options_;
+    std::mutex options_mutex_;
+    // 最后声明、最先析构：先等所有任务结束，再释放连接池等其他成员
+    Executor executor_;
+};
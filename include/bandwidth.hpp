@@ -0,0 +1,124 @@
+// bandwidth.hpp
+#pragma once
+#include "transfer.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// 令牌桶，rate为字节/秒，0表示不限速。本身不加锁，由BandwidthLimiter在锁内使用。
+// 令牌可以扣成负数：大于桶容量的块也能通过，欠下的部分由后续请求等待补上
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // 容量为kBurstSeconds的流量，至少kMinBurst字节
+    static constexpr double kBurstSeconds = 0.1;
+    static constexpr double kMinBurst = 64 << 10;
+
+    uint64_t rate() const { return rate_; }
+    // 先按旧速率补足到now，再换成新速率
+    void set_rate(uint64_t rate, Clock::time_point now);
+    void refill(Clock::time_point now);
+    bool ready(size_t bytes) const;
+    void take(size_t bytes);
+    // 距ready(bytes)还要等的时间
+    Clock::duration wait_time(size_t bytes) const;
+
+private:
+    double need(size_t bytes) const;
+
+    uint64_t rate_ = 0;
+    double burst_ = kMinBurst;
+    double tokens_ = kMinBurst;
+    Clock::time_point last_;
+};
+
+// 一个传输的权重和限速，传输进行中可随时修改。
+// 多个操作共用同一个TransferFlow时合计受其限速约束，并在公平调度中算作一个流
+class TransferFlow {
+public:
+    explicit TransferFlow(unsigned weight = 1, uint64_t max_rate = 0)
+        : weight_(weight > 0 ? weight : 1), max_rate_(max_rate) {}
+
+    TransferFlow(const TransferFlow&) = delete;
+    TransferFlow& operator=(const TransferFlow&) = delete;
+
+    // 共享带宽不足时，各流按权重比例分配
+    void set_weight(unsigned weight) { weight_ = weight > 0 ? weight : 1; }
+    // 字节/秒，0表示不单独限速
+    void set_max_rate(uint64_t bytes_per_sec) { max_rate_ = bytes_per_sec; }
+    unsigned weight() const { return weight_; }
+    uint64_t max_rate() const { return max_rate_; }
+
+private:
+    friend class BandwidthLimiter;
+
+    std::atomic<unsigned> weight_;
+    std::atomic<uint64_t> max_rate_;
+    // 以下只在BandwidthLimiter的锁内访问
+    TokenBucket bucket_;
+    double finish_ = 0;  // 该流上一个请求的虚拟完成时间
+};
+
+// 全局、每服务器、每传输三级令牌桶，以及在共享桶前排队的加权公平调度(start-time fair queuing)：
+// 等待同一个全局或服务器桶的请求按虚拟开始时间依次放行，流的虚拟时间按字节数/权重推进，
+// 所以带宽不足时高权重的前台传输先走，低权重的后台同步只用剩下的部分。
+// 只被自己限速挡住的请求不占用共享桶。限速都可以在运行时修改，正在等待的请求立即按新值重新计算。
+class BandwidthLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+
+    // SambaClient的传输使用的实例
+    static BandwidthLimiter& global();
+
+    BandwidthLimiter() = default;
+    BandwidthLimiter(const BandwidthLimiter&) = delete;
+    BandwidthLimiter& operator=(const BandwidthLimiter&) = delete;
+
+    // 字节/秒，0表示不限速；server为server_label(ip, port)
+    void set_global_rate(uint64_t bytes_per_sec);
+    void set_server_rate(const std::string& server, uint64_t bytes_per_sec);
+    uint64_t global_rate() const;
+    uint64_t server_rate(const std::string& server) const;
+
+    // 向server传输了bytes字节后调用，按需等待令牌；
+    // 等待中被取消或超过截止时间时提前返回control.stop_reason()，否则返回0。
+    // 没有任何限速时不加锁直接返回
+    int consume(const std::string& server, TransferFlow& flow, size_t bytes,
+                const TransferControl& control);
+
+private:
+    struct Waiter {
+        TransferFlow* flow;
+        TokenBucket* server;  // 该服务器不限速时为空
+        size_t bytes;
+        double tag;           // 虚拟开始时间
+        uint64_t seq;
+        bool granted = false;
+    };
+    struct WaiterOrder {
+        bool operator()(const Waiter* a, const Waiter* b) const {
+            return a->tag != b->tag ? a->tag < b->tag : a->seq < b->seq;
+        }
+    };
+
+    // 按虚拟开始时间放行令牌足够的请求
+    void dispatch(Clock::time_point now);
+    // w还需等待的时间
+    Clock::duration wait_time(const Waiter& w) const;
+    void update_limited();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    TokenBucket global_;
+    std::unordered_map<std::string, TokenBucket> servers_;
+    std::set<Waiter*, WaiterOrder> waiters_;
+    double virtual_time_ = 0;
+    uint64_t next_seq_ = 0;
+    std::atomic<bool> limited_{false};  // 全局或任一服务器有限速
+};
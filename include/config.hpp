@@ -0,0 +1,45 @@
+// config.hpp
+#pragma once
+#include "context_pool.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ServerConfig {
+    std::string ip;
+    int port = 445;
+    std::string share_name;
+    int max_concurrency = 2;  // 批量模式下该服务器同时进行的传输数
+    uint64_t max_rate = 0;    // 该服务器所有传输合计的字节/秒，0不限
+};
+
+struct AppConfig {
+    SmbCredentials credentials;
+    std::vector<ServerConfig> servers;
+    int workers = 8;  // 批量模式的工作线程数
+    uint64_t max_rate = 0;  // 所有传输合计的字节/秒，0不限
+};
+
+enum class JobType {
+    Download,
+    Upload,
+};
+
+struct TransferJob {
+    JobType type = JobType::Download;
+    ServerConfig server;
+    std::string share;
+    std::string remote_path;
+    std::string local_path;
+    int priority = 0;      // 越大越先执行
+    int max_retries = 2;   // 失败后的最大重试次数
+    bool parallel = false; // 使用多流并行传输(可续传)
+    unsigned weight = 1;   // 共享带宽不足时按权重分配
+    uint64_t max_rate = 0; // 本任务的字节/秒，0不限
+};
+
+// 读取config.json，格式错误时抛出runtime_error
+AppConfig load_config(const std::string& path);
+
+// 读取任务列表，任务里的"server"可以是servers数组下标或"ip:port"
+std::vector<TransferJob> load_jobs(const std::string& path, const AppConfig& config);
@@ -0,0 +1,119 @@
+// context_pool.hpp
+#pragma once
+#include <chrono>
+#include "transfer.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef struct _SMBCCTX SMBCCTX;
+
+struct SmbCredentials {
+    std::string username = "wjj";
+    std::string password = "20030509a";
+    std::string workgroup = "WORKGROUP";
+};
+
+struct ContextPoolOptions {
+    size_t max_per_key = 8;        // 每个ip:port:share最多同时存在的上下文数
+    size_t max_total = 64;         // 整个池的上下文上限
+    int idle_timeout_ms = 60000;   // 空闲超过该时间的上下文被回收
+    int health_check_ms = 15000;   // 空闲超过该时间，借出前先做一次健康检查
+    int smb_timeout_ms = 5000;     // libsmbclient请求超时
+};
+
+class SmbContextPool;
+
+// 借出的上下文，析构时自动归还；操作中发现连接已坏时调用invalidate()丢弃
+class ContextLease {
+public:
+    ContextLease() = default;
+    ContextLease(ContextLease&& other) noexcept;
+    ContextLease& operator=(ContextLease&& other) noexcept;
+    ContextLease(const ContextLease&) = delete;
+    ContextLease& operator=(const ContextLease&) = delete;
+    ~ContextLease();
+
+    SMBCCTX* get() const { return ctx_; }
+    // 新建的上下文，第一个请求会建立连接并认证
+    bool fresh() const { return fresh_; }
+    void invalidate() { broken_ = true; }
+    // 本次借用期间缩短libsmbclient请求超时(用于截止时间)，归还时恢复池的默认值
+    void limit_timeout(int timeout_ms);
+
+private:
+    friend class SmbContextPool;
+    ContextLease(SmbContextPool* pool, std::string key, SMBCCTX* ctx, bool fresh)
+        : pool_(pool), key_(std::move(key)), ctx_(ctx), fresh_(fresh) {}
+    void release();
+
+    SmbContextPool* pool_ = nullptr;
+    std::string key_;
+    SMBCCTX* ctx_ = nullptr;
+    bool fresh_ = false;
+    bool broken_ = false;
+    bool timeout_limited_ = false;
+};
+
+// 按ip:port:share分组复用已认证的SMB上下文，线程安全。
+// libsmbclient的单个上下文不能被多个线程同时使用，所以每次借出独占一个。
+class SmbContextPool {
+public:
+    explicit SmbContextPool(const SmbCredentials& credentials = SmbCredentials(),
+                            const ContextPoolOptions& options = ContextPoolOptions());
+    ~SmbContextPool();
+
+    SmbContextPool(const SmbContextPool&) = delete;
+    SmbContextPool& operator=(const SmbContextPool&) = delete;
+
+    // 达到上限时阻塞等待归还；创建上下文失败时抛出runtime_error
+    ContextLease acquire(const std::string& ip, int port, const std::string& share = "");
+    // 等待期间被取消或超过截止时间时返回空租约(get()为nullptr)，errno为ECANCELED/ETIMEDOUT
+    ContextLease acquire(const std::string& ip, int port, const std::string& share,
+                         const TransferControl& control);
+
+    // 回收空闲超时的上下文
+    void evict_idle();
+
+    size_t size() const;
+    size_t idle() const;
+
+private:
+    friend class ContextLease;
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        SMBCCTX* ctx;
+        Clock::time_point last_used;
+    };
+    struct Bucket {
+        std::vector<Entry> idle;  // 尾部是最近归还的
+        size_t total = 0;         // 空闲 + 借出
+    };
+
+    static void auth_fn(SMBCCTX* ctx, const char* server, const char* share,
+                        char* workgroup, int wgmaxlen,
+                        char* username, int unmaxlen,
+                        char* password, int pwmaxlen);
+
+    ContextLease do_acquire(const std::string& ip, int port, const std::string& share,
+                            const TransferControl* control);
+    SMBCCTX* create_context();
+    static void destroy_context(SMBCCTX* ctx);
+    bool healthy(SMBCCTX* ctx, const std::string& ip, int port, const std::string& share);
+    void release(const std::string& key, SMBCCTX* ctx, bool broken);
+    // 调用方持有锁，被移出的上下文放入out，由调用方在锁外释放
+    void collect_idle(Clock::time_point now, std::vector<SMBCCTX*>& out);
+    bool steal_idle(const std::string& except_key, std::vector<SMBCCTX*>& out);
+
+    SmbCredentials credentials_;
+    ContextPoolOptions options_;
+    std::unordered_map<std::string, Bucket> buckets_;
+    size_t total_ = 0;
+    Clock::time_point last_sweep_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+};
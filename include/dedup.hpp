@@ -0,0 +1,91 @@
+// dedup.hpp
+#pragma once
+#include "samba_client.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DedupOptions {
+    size_t min_chunk = 16 << 10;   // FastCDC分块的最小/平均/最大长度
+    size_t avg_chunk = 64 << 10;
+    size_t max_chunk = 256 << 10;
+    int zstd_level = 3;            // 压缩后没有变小的块原样存储
+    std::string store_dir = ".pcnstore";  // 共享上存放pack和索引段的目录
+    std::string cache_dir;         // 本地索引段缓存，为空时使用~/.cache/pc_neighbor/dedup
+};
+
+struct DedupStats {
+    uint64_t logical_bytes = 0;  // 文件原始大小
+    size_t chunks = 0;
+    size_t new_chunks = 0;       // 共享上还没有、本次写入pack的块
+    uint64_t new_bytes = 0;      // 新块的原始字节数
+    uint64_t stored_bytes = 0;   // 新块压缩后的字节数
+    uint64_t sent_bytes = 0;     // 经网络传输的字节数：上传为pack+索引段+清单，下载为读取的pack区间
+    double seconds = 0;
+};
+
+// 块内容的XXH3-128哈希
+struct ChunkHash {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool operator==(const ChunkHash& other) const { return lo == other.lo && hi == other.hi; }
+};
+
+struct ChunkHashHasher {
+    size_t operator()(const ChunkHash& h) const { return static_cast<size_t>(h.lo); }
+};
+
+// 块在共享上的位置：<store_dir>/packs/<pack>.pack的[offset, offset+stored_size)
+struct ChunkLocation {
+    std::string pack;
+    uint64_t offset = 0;
+    uint32_t stored_size = 0;
+    uint32_t raw_size = 0;
+    uint8_t codec = 0;  // 0原样，1 zstd
+};
+
+// FastCDC内容定义分块，返回各块长度；插入或删除数据只影响附近的切分点
+std::vector<uint32_t> cdc_chunks(const uint8_t* data, size_t size, const DedupOptions& options);
+
+// 一个共享上的内容寻址块存储。上传时文件按内容切块，共享上已有的块跳过，
+// 新块用zstd压缩后追加到一个新pack；每个pack配一个不可变的索引段，
+// 所有索引段的并集就是该共享的块索引，多个客户端并发上传不需要加锁。
+// 文件本身在共享上是一个清单(<remote_path>.pcnm)，列出按顺序拼接的块。
+class DedupStore {
+public:
+    DedupStore(std::shared_ptr<SmbContextPool> pool, const std::string& ip, int port,
+               const std::string& share, const DedupOptions& options = DedupOptions());
+
+    bool upload(const std::string& local_path, const std::string& remote_path);
+    // 读取清单，按pack合并相邻块的读取，解压并校验哈希后还原原文件
+    bool download(const std::string& remote_path, const std::string& local_path);
+
+    const DedupStats& stats() const { return stats_; }
+
+    static constexpr const char* kManifestSuffix = ".pcnm";
+
+private:
+    using Index = std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher>;
+
+    // 列出共享上的索引段，只载入index_中还没有的段：首次调用先读本地合并索引，
+    // 之后只读新出现的段(本地缓存中没有的先下载)，有新段时重写合并索引。
+    // 合并索引里的段在共享上已不存在或大小不符时整体作废，全部重新载入
+    bool load_index();
+    // loaded_有变化时重写本地合并索引(先写临时文件再rename)
+    bool save_merged();
+    std::string store_path(const std::string& sub) const;
+
+    SambaClient client_;
+    std::string ip_;
+    int port_;
+    std::string share_;
+    DedupOptions options_;
+    std::string cache_dir_;
+    Index index_;
+    std::unordered_map<std::string, uint64_t> loaded_;  // 已载入index_的索引段名 -> 段大小
+    bool merged_dirty_ = false;                         // loaded_中有合并索引还没包含的段
+    DedupStats stats_;
+};
@@ -0,0 +1,73 @@
+// dir_sync.hpp
+#pragma once
+#include "samba_client.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+enum class SyncDirection {
+    Pull,  // 共享 -> 本地
+    Push,  // 本地 -> 共享
+};
+
+struct SyncOptions {
+    SyncDirection direction = SyncDirection::Pull;
+    int walkers = 8;                 // 并行遍历远端目录的线程数
+    int transfers = 8;               // 并行传输文件的线程数
+    bool use_hash = false;           // Push时大小相同但mtime变化的文件先比较内容哈希
+    bool delete_extraneous = false;  // 删除上次同步过、但源端已不存在的文件
+    std::string index_name = ".pcnsync.idx";  // 索引文件，位于本地根目录
+    int index_save_ms = 5000;        // 传输期间每隔该时间保存一次索引
+    std::shared_ptr<TransferFlow> flow;  // 所有文件传输共用的权重和限速，为空时各文件按权重1
+};
+
+struct SyncStats {
+    size_t files = 0;        // 源端文件数
+    size_t dirs = 0;         // 远端目录数
+    size_t transferred = 0;
+    size_t skipped = 0;      // 与索引一致，未传输
+    size_t failed = 0;
+    size_t deleted = 0;
+    uint64_t bytes = 0;
+    double walk_seconds = 0;
+    double transfer_seconds = 0;
+};
+
+// 上次同步成功时记录的状态
+struct SyncIndexEntry {
+    uint64_t size = 0;
+    int64_t remote_mtime = 0;
+    int64_t local_mtime = 0;
+    uint64_t hash = 0;  // use_hash时为本地内容哈希，否则为0
+};
+
+// 本地目录树与共享之间的递归增量同步。
+// 每个文件上次同步后的大小/mtime(和可选哈希)保存在本地索引中，
+// 再次同步时只传输与索引不一致的文件，小文件在多个连接上并发传输。
+class DirectorySync {
+public:
+    explicit DirectorySync(std::shared_ptr<SmbContextPool> pool,
+                           const SyncOptions& options = SyncOptions());
+
+    // remote_root和local_root都是目录；全部文件同步成功时返回true
+    bool sync(const std::string& ip, int port, const std::string& share,
+              const std::string& remote_root, const std::string& local_root);
+
+    const SyncStats& stats() const { return stats_; }
+
+private:
+    using Index = std::unordered_map<std::string, SyncIndexEntry>;
+
+    // 并行遍历远端目录树，文件按相对路径放入files，目录放入dirs
+    bool walk_remote(const std::string& ip, int port, const std::string& share,
+                     const std::string& remote_root,
+                     std::unordered_map<std::string, RemoteEntry>& files,
+                     std::vector<std::string>& dirs);
+
+    bool load_index(const std::string& path, const std::string& target, Index& index);
+    bool save_index(const std::string& path, const std::string& target, const Index& index);
+
+    std::shared_ptr<SmbContextPool> pool_;
+    SyncOptions options_;
+    SyncStats stats_;
+};
@@ -0,0 +1,70 @@
+// discovery.hpp
+#pragma once
+#include "samba_client.hpp"
+#include <memory>
+#include <vector>
+#include <string>
+
+struct SambaService {
+    std::string ip;
+    int port;
+    std::vector<SambaShare> shares;
+};
+
+struct ProbeTarget {
+    std::string ip;
+    int port;
+};
+
+struct DiscoveryOptions {
+    int connect_timeout_ms = 300;  // 单个TCP探测的截止时间
+    int max_inflight = 1024;       // 同时进行中的非阻塞connect上限
+    int smb_workers = 8;           // SMB握手/列共享的工作线程数
+};
+
+// 各阶段耗时统计
+struct DiscoveryStats {
+    size_t probed = 0;     // 探测的ip:port数量
+    size_t open = 0;       // 接受TCP连接的数量
+    size_t services = 0;   // 成功列出共享的数量
+    double probe_ms = 0;   // TCP探测阶段耗时
+    double smb_ms = 0;     // SMB握手+列共享阶段耗时
+};
+
+// 非阻塞TCP connect探测(epoll)，返回接受连接的目标，顺序与输入一致
+std::vector<ProbeTarget> probe_tcp(const std::vector<ProbeTarget>& targets,
+                                   int timeout_ms, int max_inflight);
+
+// 展开 "192.168.1.0/24" 形式的网段，单个IP原样返回
+std::vector<std::string> expand_cidr(const std::string& spec);
+// 网段(或单个IP)包含的主机地址范围[first, last]，主机字节序；格式错误时抛出runtime_error
+void cidr_range(const std::string& spec, uint32_t& first, uint32_t& last);
+
+class DiscoveryEngine {
+public:
+    // SMB阶段的工作线程共享pool中的上下文，为空时自建一个
+    explicit DiscoveryEngine(const DiscoveryOptions& options = DiscoveryOptions(),
+                             std::shared_ptr<SmbContextPool> pool = nullptr);
+
+    // 标准Samba端口 + 4455-4464
+    static std::vector<int> default_ports();
+
+    std::vector<SambaService> discover(const std::vector<std::string>& ips,
+                                       const std::vector<int>& ports = default_ports());
+    std::vector<SambaService> discover(const std::vector<ProbeTarget>& targets);
+
+    // 只做TCP探测阶段，重置stats并记录探测部分
+    std::vector<ProbeTarget> probe(const std::vector<ProbeTarget>& targets);
+
+    // 只做SMB阶段：对已知开放的端口列共享，更新stats中的SMB部分
+    std::vector<SambaService> list_open(const std::vector<ProbeTarget>& open);
+
+    const DiscoveryOptions& options() const { return options_; }
+
+    const DiscoveryStats& stats() const { return stats_; }
+
+private:
+    DiscoveryOptions options_;
+    DiscoveryStats stats_;
+    std::shared_ptr<SmbContextPool> pool_;
+};
@@ -0,0 +1,78 @@
+// discovery_cache.hpp
+#pragma once
+#include "discovery.hpp"
+#include "scanner.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct DiscoveryCacheOptions {
+    int service_ttl_s = 600;  // 超过该时间的共享列表需要重新做SMB握手确认
+    int device_ttl_s = 3600;  // 超过该时间未再出现的设备记录被丢弃
+};
+
+// 发现结果的磁盘缓存：SambaService和DeviceInfo记录，带检查时间。
+// 文件是紧凑的二进制格式，加载时整体mmap后解析，写入时先写临时文件再rename。
+class DiscoveryCache {
+public:
+    explicit DiscoveryCache(const std::string& path,
+                            const DiscoveryCacheOptions& options = DiscoveryCacheOptions());
+
+    // 文件不存在或格式不对时返回false，缓存为空
+    bool load();
+    bool save() const;
+
+    bool empty() const { return services_.empty(); }
+
+    // 缓存中的所有服务(包括已过期的)，按ip:port排序
+    std::vector<SambaService> services() const;
+    // 只返回指定主机上的服务
+    std::vector<SambaService> services(const std::vector<std::string>& ips) const;
+    std::vector<DeviceInfo> devices() const;
+
+    // 服务记录仍在TTL内，且对应主机的MAC没有变化
+    bool fresh(const ProbeTarget& target, int64_t now) const;
+
+    // 用一轮探测结果更新：probed中未开放的目标被移除，found中的服务刷新检查时间，
+    // 开放但已过期且这次没列出共享的目标也被移除
+    void update_services(const std::vector<ProbeTarget>& probed,
+                         const std::vector<ProbeTarget>& open,
+                         const std::vector<SambaService>& found, int64_t now);
+    // 记录设备，MAC变化的主机其服务记录标记为过期
+    void update_devices(const std::vector<DeviceInfo>& devices, int64_t now);
+
+    static int64_t now();
+    // $XDG_CACHE_HOME/pc_neighbor/discovery.cache，退回到~/.cache
+    static std::string default_path();
+
+private:
+    struct ServiceRecord {
+        SambaService service;
+        int64_t checked_at = 0;
+    };
+    struct DeviceRecord {
+        DeviceInfo device;
+        int64_t seen_at = 0;
+    };
+
+    static std::string key(const std::string& ip, int port);
+
+    std::string path_;
+    DiscoveryCacheOptions options_;
+    std::map<std::string, ServiceRecord> services_;  // 键为ip:port
+    std::map<std::string, DeviceRecord> devices_;    // 键为ip
+};
+
+// 用缓存加速重新发现：先对ips x ports做TCP探测，只对新开放、记录过期
+// 或MAC变化的目标做SMB握手，其余沿用缓存中的共享列表
+std::vector<SambaService> revalidate(DiscoveryEngine& engine, DiscoveryCache& cache,
+                                     const std::vector<std::string>& ips,
+                                     const std::vector<int>& ports = DiscoveryEngine::default_ports());
+
+// revalidate探测之后的部分，供自己做了探测的调用方使用：probed中没开放的目标从缓存移除，
+// open(可以含没探测过的目标，如mDNS广播的)中需要确认的只做一次SMB阶段。
+// 返回probed和open涉及的主机上的服务
+std::vector<SambaService> revalidate_open(DiscoveryEngine& engine, DiscoveryCache& cache,
+                                          const std::vector<ProbeTarget>& probed,
+                                          const std::vector<ProbeTarget>& open);
@@ -0,0 +1,59 @@
+// job_scheduler.hpp
+#pragma once
+#include "config.hpp"
+#include "context_pool.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct SchedulerOptions {
+    int workers = 8;              // 全局并发上限
+    int backoff_ms = 500;         // 第一次重试前的等待，之后每次翻倍
+    int max_backoff_ms = 30000;
+};
+
+struct JobResult {
+    TransferJob job;
+    bool ok = false;
+    int attempts = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;  // 最后一次尝试的耗时
+};
+
+struct SchedulerStats {
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t retries = 0;
+    uint64_t bytes = 0;
+    double wall_seconds = 0;
+    // 成功传输的单次耗时分布
+    double p50_ms = 0;
+    double p95_ms = 0;
+    double max_ms = 0;
+
+    double bytes_per_sec() const { return wall_seconds > 0 ? bytes / wall_seconds : 0; }
+};
+
+// 并发执行一批传输任务：高优先级先执行，每台服务器的并发数受
+// ServerConfig::max_concurrency限制，失败的任务按指数退避重试
+class JobScheduler {
+public:
+    explicit JobScheduler(std::shared_ptr<SmbContextPool> pool,
+                          const SchedulerOptions& options = SchedulerOptions());
+
+    void submit(const TransferJob& job);
+
+    // 阻塞直到所有任务完成或用尽重试，结果顺序与提交顺序一致
+    std::vector<JobResult> run();
+
+    const SchedulerStats& stats() const { return stats_; }
+
+private:
+    JobResult execute(const TransferJob& job);
+    int backoff_for(int attempt) const;
+
+    std::shared_ptr<SmbContextPool> pool_;
+    SchedulerOptions options_;
+    std::vector<TransferJob> jobs_;
+    SchedulerStats stats_;
+};
@@ -0,0 +1,75 @@
+// mdns_browser.hpp
+#pragma once
+#include "discovery.hpp"
+#include "scanner.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 一条解析完成的DNS-SD记录
+struct MdnsRecord {
+    std::string type;          // _smb._tcp 或 _device-info._tcp
+    std::string service_name;  // 实例名，如 "PC_NEIGHBOR_1"
+    std::string host_name;     // 如 "pc-neighbor.local"
+    std::string ip;
+    int port = 0;
+    std::string model;         // _device-info._tcp的model= TXT记录
+};
+
+// 浏览后端：默认使用Avahi，测试时可以替换成直接产生记录的桩
+class MdnsBackend {
+public:
+    using Callback = std::function<void(const MdnsRecord&)>;
+
+    virtual ~MdnsBackend() = default;
+    // 开始异步浏览，每解析出一条记录在后端线程中调用一次callback
+    virtual void start(const std::vector<std::string>& types, Callback callback) = 0;
+    virtual void stop() = 0;
+};
+
+// 连接本机avahi-daemon，daemon不可用时start()抛出runtime_error
+std::unique_ptr<MdnsBackend> make_avahi_backend();
+
+class MdnsBrowser {
+public:
+    explicit MdnsBrowser(std::unique_ptr<MdnsBackend> backend = nullptr);
+    ~MdnsBrowser();
+
+    // 异步浏览_smb._tcp和_device-info._tcp，记录随解析流式交给callback
+    void start(MdnsBackend::Callback callback = nullptr);
+    void stop();
+
+    // 到目前为止收到的记录(线程安全)
+    std::vector<MdnsRecord> records() const;
+
+    // 等到start()之后window_ms为止(已超过则不等)，停止浏览并返回所有记录。
+    // 与其他发现工作并行时保证至少浏览这么久，不会因为其他工作结束得早而几乎收不到记录
+    std::vector<MdnsRecord> wait(int window_ms);
+
+    // 同步便捷接口：浏览timeout_ms后返回所有记录
+    std::vector<MdnsRecord> browse(int timeout_ms);
+
+private:
+    std::unique_ptr<MdnsBackend> backend_;
+    std::chrono::steady_clock::time_point started_at_;
+    MdnsBackend::Callback callback_;
+    std::vector<MdnsRecord> records_;
+    mutable std::mutex mutex_;
+    bool running_ = false;
+};
+
+// 广播了_smb._tcp的ip:port，可以跳过TCP探测直接做SMB握手
+std::vector<ProbeTarget> smb_targets(const std::vector<MdnsRecord>& records);
+
+// 去掉已广播_smb._tcp的目标：它们已知开放，不需要再做TCP探测
+std::vector<ProbeTarget> without_advertised(const std::vector<ProbeTarget>& targets,
+                                            const std::vector<MdnsRecord>& records);
+
+// 用mDNS记录填充DeviceInfo::name(按IP匹配，优先取_smb._tcp实例名)
+void apply_names(std::vector<DeviceInfo>& devices, const std::vector<MdnsRecord>& records);
+
+// 把广播了_smb._tcp的ip:port并入探测得到的open(已有的不重复)，与探测结果一起做一次SMB阶段
+void add_advertised(std::vector<ProbeTarget>& open, const std::vector<MdnsRecord>& records);
@@ -0,0 +1,155 @@
+// metrics.hpp
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// 被计量的SMB操作。connect是新建上下文上的第一个请求，
+// 包含TCP连接、协商、认证和tree connect(libsmbclient不单独暴露这些阶段)
+enum class SmbOp {
+    Acquire,     // 从连接池借出上下文(含等待和健康检查)
+    Connect,
+    Auth,        // 认证回调，次数即会话建立次数
+    Open,
+    OpenDir,
+    Read,        // 单次smbc_read
+    Write,       // 单次smbc_write
+    Close,
+    Stat,
+    Mkdir,
+    Unlink,
+    Truncate,
+    Rename,
+    Check,       // 整个check_samba
+    ListShares,  // 整个list_shares
+    Download,    // 整个download，含本地IO
+    Upload,
+};
+
+const char* op_name(SmbOp op);
+
+class Metrics;
+
+// 一组(操作, 服务器, 共享)的计数，全部是原子量，热路径上不加锁
+class OpSeries {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // 延迟直方图上界(微秒)，最后一个桶是+Inf
+    static constexpr size_t kBuckets = 18;
+    static const uint64_t kBoundsUs[kBuckets - 1];
+
+    OpSeries(Metrics* owner, SmbOp op, std::string server, std::string share);
+
+    // 记录一次从start到现在的操作，error为errno，0表示成功；不改变errno
+    void record(Clock::time_point start, uint64_t bytes = 0, int error = 0);
+
+    SmbOp op() const { return op_; }
+    const std::string& server() const { return server_; }
+    const std::string& share() const { return share_; }
+
+private:
+    friend class Metrics;
+
+    Metrics* owner_;
+    SmbOp op_;
+    std::string server_;
+    std::string share_;
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::mutex error_mutex_;
+    std::map<int, uint64_t> errors_;  // errno -> 次数，只在失败时加锁
+};
+
+// 一次调用的追踪记录，时间相对进程内Metrics创建时刻
+struct TraceSpan {
+    SmbOp op;
+    std::string server;
+    std::string share;
+    uint64_t thread = 0;
+    uint64_t start_us = 0;
+    uint64_t duration_us = 0;
+    uint64_t bytes = 0;
+    int error = 0;
+};
+
+// 进程内的指标注册表，线程安全；常开，追踪默认关闭
+class Metrics {
+public:
+    static Metrics& global();
+
+    Metrics();
+
+    // 找到或创建序列，返回的引用在Metrics生命周期内有效；
+    // 循环里重复记录同一序列时应先取出引用
+    OpSeries& series(SmbOp op, const std::string& server, const std::string& share);
+
+    void add_retry(const std::string& server, const std::string& share);
+
+    // 开启后每次record额外保存一条span，超过capacity时覆盖最旧的
+    void enable_tracing(size_t capacity = 65536);
+    bool tracing() const { return tracing_.load(std::memory_order_relaxed); }
+    std::vector<TraceSpan> spans() const;
+
+    // Prometheus文本格式 / JSON快照
+    std::string prometheus() const;
+    std::string json() const;
+    // 以.json结尾写JSON，否则写Prometheus文本；先写临时文件再rename
+    bool write(const std::string& path) const;
+    // Chrome trace event格式，可用chrome://tracing或Perfetto打开
+    bool write_trace(const std::string& path) const;
+
+    // 计数清零，已有序列保留
+    void reset();
+
+private:
+    friend class OpSeries;
+    using Key = std::tuple<int, std::string, std::string>;
+
+    void add_span(const OpSeries& series, OpSeries::Clock::time_point start,
+                  uint64_t duration_ns, uint64_t bytes, int error);
+
+    OpSeries::Clock::time_point epoch_;
+    mutable std::mutex mutex_;
+    std::map<Key, std::unique_ptr<OpSeries>> series_;
+    std::map<std::pair<std::string, std::string>, uint64_t> retries_;
+
+    std::atomic<bool> tracing_{false};
+    mutable std::mutex trace_mutex_;
+    std::vector<TraceSpan> spans_;
+    size_t trace_capacity_ = 0;
+    size_t trace_next_ = 0;
+};
+
+// 作用域计时：析构时把耗时、字节数和错误记入对应序列
+class OpTimer {
+public:
+    OpTimer(SmbOp op, const std::string& server, const std::string& share)
+        : series_(Metrics::global().series(op, server, share)), start_(OpSeries::Clock::now()) {}
+    ~OpTimer() { series_.record(start_, bytes_, error_); }
+
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+    void add_bytes(uint64_t n) { bytes_ += n; }
+    void fail(int error) { error_ = error; }
+
+private:
+    OpSeries& series_;
+    OpSeries::Clock::time_point start_;
+    uint64_t bytes_ = 0;
+    int error_ = 0;
+};
+
+// 指标里服务器标签的统一写法
+inline std::string server_label(const std::string& ip, int port) {
+    return ip + ":" + std::to_string(port);
+}
@@ -0,0 +1,49 @@
+// parallel_transfer.hpp
+#pragma once
+#include "samba_client.hpp"
+#include <memory>
+#include <string>
+
+class RangeState;
+
+struct ParallelOptions {
+    int streams = 4;                 // 并发SMB连接数，每个连接借用一个独立上下文
+    uint64_t range_size = 64 << 20;  // 分段大小，也是续传的粒度
+    size_t chunk_size = 4 << 20;     // 分段内单次读写大小
+    bool resume = true;              // 存在匹配的续传状态文件时只传未完成的分段
+    std::shared_ptr<TransferFlow> flow;  // 所有流共用的权重和限速，为空时各分段按权重1
+};
+
+// 把单个大文件切成若干字节区间，在多个SMB连接上并发传输。
+// 已完成的区间记录在本地状态文件(<本地路径>.pcnpart / .pcnup)的位图中，
+// 中断后再次调用同一传输会跳过已完成的区间，全部完成后删除状态文件。
+class ParallelTransfer {
+public:
+    // 各流从pool借用上下文，为空时自建一个；池的max_per_key应不小于streams
+    explicit ParallelTransfer(const ParallelOptions& options = ParallelOptions(),
+                              std::shared_ptr<SmbContextPool> pool = nullptr);
+
+    bool download(const std::string& ip, const std::string& share,
+                  const std::string& remote_path, const std::string& local_path,
+                  int port = 445);
+
+    bool upload(const std::string& ip, const std::string& share,
+                const std::string& local_path, const std::string& remote_path,
+                int port = 445);
+
+    // 本次调用实际传输的字节数和耗时(不含续传前已完成的部分)
+    const TransferStats& stats() const { return stats_; }
+
+private:
+    using RangeFn = bool (SambaClient::*)(const std::string&, const std::string&,
+                                          const std::string&, int,
+                                          uint64_t, uint64_t, int);
+
+    bool run(const std::string& ip, const std::string& share, const std::string& remote_path,
+             int port, int local_fd, uint64_t size, RangeState& state, RangeFn fn,
+             bool sync_local);
+
+    ParallelOptions options_;
+    TransferStats stats_;
+    std::shared_ptr<SmbContextPool> pool_;
+};
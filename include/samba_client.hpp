@@ -1,35 +1,104 @@
 // samba_client.hpp
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <string>
 #include <stdexcept>  // 添加这行以包含runtime_error
+#include <memory>
+#include "transfer.hpp"
+#include "context_pool.hpp"
+
+class OpTimer;
 
 struct SambaShare {
     std::string name;
     std::string path;
 };
 
+// 远端目录项，mtime为Unix秒
+struct RemoteEntry {
+    std::string name;
+    bool is_dir = false;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
 class SambaClient {
 public:
-    SambaClient();
-    ~SambaClient();
+    // 每次调用从连接池借用上下文。默认使用独立的池；
+    // 多个线程各自构造SambaClient并共享同一个池即可并发复用已认证的会话
+    explicit SambaClient(std::shared_ptr<SmbContextPool> pool = nullptr);
+
+    const std::shared_ptr<SmbContextPool>& context_pool() const { return pool; }
 
     std::vector<int> find_samba_ports(const std::string& ip);
-    
+
     // 检查Samba服务是否可用
     bool check_samba(const std::string& ip, int port = 445);
-    
+
     // 列出共享目录
     std::vector<SambaShare> list_shares(const std::string& ip, int port = 445);
-    
-    // 文件操作
+
+    // 文件操作；download/upload和下面的分段读写按块受BandwidthLimiter::global()限速
     bool download(const std::string& ip, const std::string& share,
-                 const std::string& remote_path, const std::string& local_path);
-                 
+                 const std::string& remote_path, const std::string& local_path,
+                 int port = 445);
+
     bool upload(const std::string& ip, const std::string& share,
-               const std::string& local_path, const std::string& remote_path);
-    
+               const std::string& local_path, const std::string& remote_path,
+               int port = 445);
+
+    // 分段读写：供多流并行传输使用，每个线程持有自己的SambaClient
+    // 远端文件大小，失败返回-1
+    int64_t remote_size(const std::string& ip, const std::string& share,
+                        const std::string& remote_path, int port = 445);
+    // 创建(截断)远端文件并设置为指定大小
+    bool create_remote(const std::string& ip, const std::string& share,
+                       const std::string& remote_path, int64_t size, int port = 445);
+    // 远端[offset, offset+length) -> 本地fd同一区间
+    bool read_range(const std::string& ip, const std::string& share,
+                    const std::string& remote_path, int local_fd,
+                    uint64_t offset, uint64_t length, int port = 445);
+    // 本地fd的[offset, offset+length) -> 远端同一区间
+    bool write_range(const std::string& ip, const std::string& share,
+                     const std::string& remote_path, int local_fd,
+                     uint64_t offset, uint64_t length, int port = 445);
+
+    // 目录操作：供目录同步使用，路径相对共享根目录
+    // 列出目录(不含.和..)，大小和修改时间随列表一起返回，不逐个stat
+    bool list_dir(const std::string& ip, const std::string& share,
+                  const std::string& remote_dir, std::vector<RemoteEntry>& entries,
+                  int port = 445);
+    bool stat_remote(const std::string& ip, const std::string& share,
+                     const std::string& remote_path, RemoteEntry& entry, int port = 445);
+    // 目录已存在也视为成功
+    bool make_dir(const std::string& ip, const std::string& share,
+                  const std::string& remote_dir, int port = 445);
+    bool remove_remote(const std::string& ip, const std::string& share,
+                       const std::string& remote_path, int port = 445);
+    // 同一共享内改名，目标已存在时由服务器决定是否覆盖
+    bool rename_remote(const std::string& ip, const std::string& share,
+                       const std::string& from, const std::string& to, int port = 445);
+
+    // 块大小/双缓冲设置，以及最近一次传输的字节数和耗时
+    void set_transfer_options(const TransferOptions& options) { transfer_options = options; }
+    const TransferStats& last_transfer() const { return last_stats; }
+    // 最近一次失败的errno，各操作的耗时和错误另见Metrics::global()；
+    // 被取消或超过截止时间时为ECANCELED / ETIMEDOUT
+    int last_error() const { return last_errno; }
+
+    // 之后各操作的取消标志、截止时间和进度回调，在块之间检查
+    void set_control(const TransferControl& control) { this->control = control; }
+
 private:
-    std::string username = "wjj";
-    std::string password = "20030509a";
-};
\ No newline at end of file
+    // 操作开始前检查是否已取消/超时(包括等待借用上下文期间)，并按截止时间收紧请求超时
+    bool begin(ContextLease& lease);
+    // 记下失败原因，连接级错误时丢弃上下文
+    void fail(ContextLease& lease, OpTimer& timer, int error);
+
+    std::shared_ptr<SmbContextPool> pool;
+    TransferOptions transfer_options;
+    TransferStats last_stats;
+    TransferControl control;
+    int last_errno = 0;
+};
@@ -9,12 +9,44 @@ struct DeviceInfo {
     std::string mac;
 };
 
+struct ArpScanOptions {
+    int rate_pps = 10000;     // 每秒发送的ARP请求数
+    std::string subnet;       // 扫描网段(如192.168.1.0/24)，为空时使用接口自身的网段
+    std::string replay_file;  // 非空时不发包，从pcap文件中读取ARP回复(离线测试)
+};
+
+// 最近一次主动扫描的覆盖情况
+struct ArpSweepStats {
+    size_t targets = 0;  // 网段内应扫描的地址数
+    size_t sent = 0;     // 超时前实际发出请求的地址数(超过一个/16的部分不扫描)
+
+    bool truncated() const { return sent < targets; }
+};
+
 class NetworkScanner {
 public:
-    // 扫描局域网设备(简化版)
+    explicit NetworkScanner(const ArpScanOptions& options = ArpScanOptions());
+
+    // 对默认接口所在子网做主动ARP扫描并合并ARP缓存，timeout_ms内返回，
+    // 超时未发完的地址见last_sweep()；没有权限发送原始报文时只读取ARP缓存
     std::vector<DeviceInfo> scan(int timeout_ms = 1000);
-    
+
+    // 使用ARP扫描发现设备：原始套接字发送请求，pcap抓取回复。
+    // 打开接口或抓包失败时抛出runtime_error
+    std::vector<DeviceInfo> arp_scan(const std::string& interface, int timeout_ms = 1000);
+
+    // 只读取内核ARP缓存，不发包；供启动和缓存重新验证等不应打扰局域网的路径使用
+    std::vector<DeviceInfo> read_arp_cache();
+
+    const ArpSweepStats& last_sweep() const { return sweep_; }
+
+    // 默认路由所在的接口(/proc/net/route)；没有默认路由时取第一个已启用、
+    // 非回环且有IPv4地址的接口，都没有则返回空
+    static std::string default_interface();
+
 private:
-    // 使用ARP扫描发现设备
-    std::vector<DeviceInfo> arp_scan(const std::string& interface);
-};
\ No newline at end of file
+    std::vector<DeviceInfo> replay(const std::string& file);
+
+    ArpScanOptions options_;
+    ArpSweepStats sweep_;
+};
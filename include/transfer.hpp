@@ -0,0 +1,81 @@
+// transfer.hpp
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+
+struct TransferOptions {
+    size_t chunk_size = 4 << 20;  // 单次smbc_read/smbc_write的块大小(上限64MiB)
+    bool pipelined = true;        // 双缓冲：本地磁盘IO与SMB读写重叠
+};
+
+struct TransferStats {
+    uint64_t bytes = 0;
+    double seconds = 0;
+
+    double bytes_per_sec() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+// 取消标志，拷贝之间共享同一状态，任意线程都可以cancel()
+class CancelToken {
+public:
+    CancelToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { flag_->store(true); }
+    bool cancelled() const { return flag_->load(); }
+    // 原始标志，供信号处理函数直接置位
+    std::atomic<bool>* flag() const { return flag_.get(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+class TransferFlow;
+
+// 已传输字节数和总字节数(未知时为0)，在执行传输的线程中调用
+using ProgressFn = std::function<void(uint64_t done, uint64_t total)>;
+
+// 单次操作的取消、截止时间、进度回调和带宽设置
+struct TransferControl {
+    using Clock = std::chrono::steady_clock;
+
+    CancelToken cancel;
+    Clock::time_point deadline = Clock::time_point::max();
+    ProgressFn progress;
+    // 权重和单独限速(见bandwidth.hpp)，为空时每个操作按权重1、不单独限速
+    std::shared_ptr<TransferFlow> flow;
+
+    // 0表示可以继续，否则为ECANCELED或ETIMEDOUT
+    int stop_reason() const {
+        if (cancel.cancelled()) return ECANCELED;
+        if (deadline != Clock::time_point::max() && Clock::now() >= deadline) return ETIMEDOUT;
+        return 0;
+    }
+    // 距截止时间的毫秒数，没有截止时间时返回-1
+    long remaining_ms() const {
+        if (deadline == Clock::time_point::max()) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+        return left.count() > 0 ? left.count() : 0;
+    }
+};
+
+// 读到的字节数，0表示EOF，<0表示出错
+using ChunkReader = std::function<ssize_t(char* buf, size_t len)>;
+// 写入的字节数，允许短写，<0表示出错
+using ChunkWriter = std::function<ssize_t(const char* buf, size_t len)>;
+
+// 每写完一块后以累计字节数调用，返回false时中止传输
+using ChunkProgress = std::function<bool(uint64_t bytes)>;
+
+constexpr size_t kMaxChunkSize = 64 << 20;
+
+// 从reader读到EOF并全部写入writer，结果记入stats；
+// pipelined时读在后台线程，写在调用线程，两块缓冲交替使用
+bool copy_stream(const ChunkReader& reader, const ChunkWriter& writer,
+                 const TransferOptions& options, TransferStats& stats,
+                 const ChunkProgress& progress = nullptr);
@@ -0,0 +1,168 @@
+// async_client.cpp
+#include "async_client.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+Executor::Executor(size_t threads) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+        threads_.emplace_back(&Executor::worker, this);
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+void Executor::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+size_t Executor::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void Executor::worker() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+AsyncSambaClient::AsyncSambaClient(std::shared_ptr<SmbContextPool> pool,
+                                   const AsyncOptions& options)
+    : pool_(pool ? std::move(pool) : std::make_shared<SmbContextPool>()),
+      executor_(options.workers) {}
+
+void AsyncSambaClient::set_transfer_options(const TransferOptions& options) {
+    std::lock_guard<std::mutex> lock(options_mutex_);
+    transfer_options_ = options;
+}
+
+void AsyncSambaClient::run(const TransferControl& control, Completion done, Operation op) {
+    TransferOptions options;
+    {
+        std::lock_guard<std::mutex> lock(options_mutex_);
+        options = transfer_options_;
+    }
+
+    executor_.post([this, control, options, done, op]() {
+        AsyncStatus status;
+        // 排队期间已被取消或超过截止时间的操作不再开始
+        if (int reason = control.stop_reason()) {
+            status.error = reason;
+        } else {
+            try {
+                SambaClient client(pool_);
+                client.set_transfer_options(options);
+                client.set_control(control);
+                status.ok = op(client);
+                status.error = status.ok ? 0 : client.last_error();
+                status.stats = client.last_transfer();
+            } catch (const std::bad_alloc&) {
+                status.error = ENOMEM;
+            } catch (const std::system_error& e) {
+                status.error = e.code().value();
+            } catch (...) {
+                // 连接池无法创建或初始化上下文；期间已被取消/超时则报告该原因
+                int reason = control.stop_reason();
+                status.error = reason ? reason : EIO;
+            }
+        }
+        // 回调抛出的异常没有调用方可以接住，不能让它终止工作线程所在的进程
+        try {
+            if (done) done(status);
+        } catch (...) {
+        }
+    });
+}
+
+std::future<AsyncStatus> AsyncSambaClient::run(const TransferControl& control, Operation op) {
+    auto promise = std::make_shared<std::promise<AsyncStatus>>();
+    std::future<AsyncStatus> result = promise->get_future();
+    run(control, [promise](const AsyncStatus& status) { promise->set_value(status); },
+        std::move(op));
+    return result;
+}
+
+std::future<AsyncStatus> AsyncSambaClient::download_async(const std::string& ip,
+                                                          const std::string& share,
+                                                          const std::string& remote_path,
+                                                          const std::string& local_path, int port,
+                                                          const TransferControl& control) {
+    return run(control, [=](SambaClient& client) {
+        return client.download(ip, share, remote_path, local_path, port);
+    });
+}
+
+std::future<AsyncStatus> AsyncSambaClient::upload_async(const std::string& ip,
+                                                        const std::string& share,
+                                                        const std::string& local_path,
+                                                        const std::string& remote_path, int port,
+                                                        const TransferControl& control) {
+    return run(control, [=](SambaClient& client) {
+        return client.upload(ip, share, local_path, remote_path, port);
+    });
+}
+
+void AsyncSambaClient::download_async(const std::string& ip, const std::string& share,
+                                      const std::string& remote_path,
+                                      const std::string& local_path, Completion done, int port,
+                                      const TransferControl& control) {
+    run(control, std::move(done), [=](SambaClient& client) {
+        return client.download(ip, share, remote_path, local_path, port);
+    });
+}
+
+void AsyncSambaClient::upload_async(const std::string& ip, const std::string& share,
+                                    const std::string& local_path,
+                                    const std::string& remote_path, Completion done, int port,
+                                    const TransferControl& control) {
+    run(control, std::move(done), [=](SambaClient& client) {
+        return client.upload(ip, share, local_path, remote_path, port);
+    });
+}
+
+std::future<bool> AsyncSambaClient::check_samba_async(const std::string& ip, int port,
+                                                      const TransferControl& control) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = promise->get_future();
+    run(control, [promise](const AsyncStatus& status) { promise->set_value(status.ok); },
+        [=](SambaClient& client) { return client.check_samba(ip, port); });
+    return result;
+}
+
+std::future<std::vector<SambaShare>> AsyncSambaClient::list_shares_async(
+    const std::string& ip, int port, const TransferControl& control) {
+    auto shares = std::make_shared<std::vector<SambaShare>>();
+    auto promise = std::make_shared<std::promise<std::vector<SambaShare>>>();
+    std::future<std::vector<SambaShare>> result = promise->get_future();
+    run(control,
+        [promise, shares](const AsyncStatus&) { promise->set_value(std::move(*shares)); },
+        [=](SambaClient& client) {
+            *shares = client.list_shares(ip, port);
+            return !shares->empty();
+        });
+    return result;
+}
@@ -0,0 +1,164 @@
+// bandwidth.cpp
+#include "bandwidth.hpp"
+#include <algorithm>
+#include <vector>
+
+void TokenBucket::set_rate(uint64_t rate, Clock::time_point now) {
+    refill(now);
+    rate_ = rate;
+    burst_ = std::max(rate * kBurstSeconds, kMinBurst);
+    tokens_ = std::min(tokens_, burst_);
+}
+
+void TokenBucket::refill(Clock::time_point now) {
+    if (rate_ > 0 && now > last_) {
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+    }
+    last_ = now;
+}
+
+// 要求的令牌数不超过桶容量，否则大块永远等不到
+double TokenBucket::need(size_t bytes) const {
+    return std::min(static_cast<double>(bytes), burst_);
+}
+
+bool TokenBucket::ready(size_t bytes) const {
+    return rate_ == 0 || tokens_ >= need(bytes);
+}
+
+void TokenBucket::take(size_t bytes) {
+    if (rate_ > 0) tokens_ -= bytes;
+}
+
+TokenBucket::Clock::duration TokenBucket::wait_time(size_t bytes) const {
+    if (ready(bytes)) return Clock::duration::zero();
+    std::chrono::duration<double> seconds((need(bytes) - tokens_) / rate_);
+    return std::chrono::duration_cast<Clock::duration>(seconds);
+}
+
+BandwidthLimiter& BandwidthLimiter::global() {
+    static BandwidthLimiter limiter;
+    return limiter;
+}
+
+void BandwidthLimiter::set_global_rate(uint64_t bytes_per_sec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        global_.set_rate(bytes_per_sec, Clock::now());
+        update_limited();
+    }
+    cv_.notify_all();
+}
+
+void BandwidthLimiter::set_server_rate(const std::string& server, uint64_t bytes_per_sec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 不删除条目：等待中的请求还持有桶的指针
+        servers_[server].set_rate(bytes_per_sec, Clock::now());
+        update_limited();
+    }
+    cv_.notify_all();
+}
+
+uint64_t BandwidthLimiter::global_rate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return global_.rate();
+}
+
+uint64_t BandwidthLimiter::server_rate(const std::string& server) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = servers_.find(server);
+    return it == servers_.end() ? 0 : it->second.rate();
+}
+
+void BandwidthLimiter::update_limited() {
+    bool limited = global_.rate() > 0;
+    for (const auto& s : servers_) {
+        limited = limited || s.second.rate() > 0;
+    }
+    limited_ = limited;
+}
+
+void BandwidthLimiter::dispatch(Clock::time_point now) {
+    global_.refill(now);
+    // 排在前面、被共享桶挡住的请求占住该桶，后面的请求不能插队
+    bool global_held = false;
+    std::vector<const TokenBucket*> servers_held;
+    bool granted = false;
+
+    for (auto it = waiters_.begin(); it != waiters_.end();) {
+        Waiter* w = *it;
+        TokenBucket& own = w->flow->bucket_;
+        uint64_t rate = w->flow->max_rate();
+        if (rate != own.rate()) {
+            own.set_rate(rate, now);
+        } else {
+            own.refill(now);
+        }
+        if (w->server) w->server->refill(now);
+
+        bool server_held = w->server &&
+            std::find(servers_held.begin(), servers_held.end(), w->server) != servers_held.end();
+        bool global_ok = !global_held && global_.ready(w->bytes);
+        bool server_ok = !w->server || (!server_held && w->server->ready(w->bytes));
+
+        if (own.ready(w->bytes) && global_ok && server_ok) {
+            own.take(w->bytes);
+            global_.take(w->bytes);
+            if (w->server) w->server->take(w->bytes);
+            virtual_time_ = std::max(virtual_time_, w->tag);
+            w->granted = true;
+            granted = true;
+            it = waiters_.erase(it);
+            continue;
+        }
+        if (own.ready(w->bytes)) {
+            if (!global_ok && global_.rate() > 0) global_held = true;
+            if (!server_ok && !server_held) servers_held.push_back(w->server);
+        }
+        ++it;
+    }
+    if (granted) cv_.notify_all();
+}
+
+BandwidthLimiter::Clock::duration BandwidthLimiter::wait_time(const Waiter& w) const {
+    Clock::duration wait = std::max(w.flow->bucket_.wait_time(w.bytes), global_.wait_time(w.bytes));
+    if (w.server) wait = std::max(wait, w.server->wait_time(w.bytes));
+    return wait;
+}
+
+int BandwidthLimiter::consume(const std::string& server, TransferFlow& flow, size_t bytes,
+                              const TransferControl& control) {
+    if (bytes == 0 || (!limited_.load(std::memory_order_relaxed) && flow.max_rate() == 0)) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Waiter w;
+    auto it = servers_.find(server);
+    w.server = it != servers_.end() && it->second.rate() > 0 ? &it->second : nullptr;
+    w.flow = &flow;
+    w.bytes = bytes;
+    w.tag = std::max(virtual_time_, flow.finish_);
+    w.seq = next_seq_++;
+    flow.finish_ = w.tag + static_cast<double>(bytes) / flow.weight();
+    waiters_.insert(&w);
+
+    // 最多等kPoll就重新检查一次：取消、截止时间和流自身限速的修改不会唤醒等待者
+    const Clock::duration kPoll = std::chrono::milliseconds(50);
+    const Clock::duration kMinWait = std::chrono::milliseconds(1);
+    for (;;) {
+        Clock::time_point now = Clock::now();
+        dispatch(now);
+        if (w.granted) return 0;
+        if (int reason = control.stop_reason()) {
+            waiters_.erase(&w);
+            // 它可能正占着共享桶，让后面的请求重新调度
+            cv_.notify_all();
+            return reason;
+        }
+        Clock::duration wait = std::min(std::max(wait_time(w), kMinWait), kPoll);
+        cv_.wait_until(lock, std::min(now + wait, control.deadline));
+    }
+}
@@ -0,0 +1,113 @@
+// config.cpp
+#include "config.hpp"
+#include <json/json.h>
+#include <fstream>
+#include <stdexcept>
+
+static Json::Value read_json(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    std::string errors;
+    if (!Json::parseFromStream(builder, in, &root, &errors)) {
+        throw std::runtime_error("Invalid JSON in " + path + ": " + errors);
+    }
+    return root;
+}
+
+AppConfig load_config(const std::string& path) {
+    Json::Value root = read_json(path);
+    AppConfig config;
+
+    config.credentials.username = root.get("username", config.credentials.username).asString();
+    config.credentials.password = root.get("password", config.credentials.password).asString();
+    config.credentials.workgroup = root.get("workgroup", config.credentials.workgroup).asString();
+    config.workers = root.get("workers", config.workers).asInt();
+    config.max_rate = root.get("max_rate", Json::UInt64(config.max_rate)).asUInt64();
+
+    for (const auto& s : root["servers"]) {
+        ServerConfig server;
+        server.ip = s["ip"].asString();
+        server.port = s.get("port", server.port).asInt();
+        server.share_name = s.get("share_name", "").asString();
+        server.max_concurrency = s.get("max_concurrency", server.max_concurrency).asInt();
+        server.max_rate = s.get("max_rate", Json::UInt64(server.max_rate)).asUInt64();
+        if (server.ip.empty()) {
+            throw std::runtime_error("Server entry without ip in " + path);
+        }
+        config.servers.push_back(server);
+    }
+    return config;
+}
+
+static ServerConfig resolve_server(const Json::Value& ref, const AppConfig& config) {
+    if (ref.isInt()) {
+        int index = ref.asInt();
+        if (index < 0 || index >= static_cast<int>(config.servers.size())) {
+            throw std::runtime_error("Job server index out of range: " + std::to_string(index));
+        }
+        return config.servers[index];
+    }
+
+    std::string spec = ref.asString();
+    for (const auto& s : config.servers) {
+        if (spec == s.ip + ":" + std::to_string(s.port)) {
+            return s;
+        }
+    }
+    // 不在配置中的服务器也允许，使用默认并发限制
+    ServerConfig server;
+    size_t colon = spec.rfind(':');
+    server.ip = spec.substr(0, colon);
+    if (colon != std::string::npos) {
+        std::string port = spec.substr(colon + 1);
+        size_t used = 0;
+        try {
+            server.port = std::stoi(port, &used);
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (used == 0 || used != port.size() || server.port <= 0 || server.port > 65535) {
+            throw std::runtime_error("Invalid port in job server: " + spec);
+        }
+    }
+    return server;
+}
+
+std::vector<TransferJob> load_jobs(const std::string& path, const AppConfig& config) {
+    Json::Value root = read_json(path);
+    const Json::Value& list = root.isArray() ? root : root["jobs"];
+
+    std::vector<TransferJob> jobs;
+    for (const auto& j : list) {
+        TransferJob job;
+        std::string type = j.get("type", "download").asString();
+        if (type == "download") {
+            job.type = JobType::Download;
+        } else if (type == "upload") {
+            job.type = JobType::Upload;
+        } else {
+            throw std::runtime_error("Unknown job type: " + type);
+        }
+
+        job.server = resolve_server(j.get("server", 0), config);
+        job.share = j.get("share", job.server.share_name).asString();
+        job.remote_path = j["remote"].asString();
+        job.local_path = j["local"].asString();
+        job.priority = j.get("priority", job.priority).asInt();
+        job.max_retries = j.get("retries", job.max_retries).asInt();
+        job.parallel = j.get("parallel", job.parallel).asBool();
+        job.weight = j.get("weight", job.weight).asUInt();
+        job.max_rate = j.get("max_rate", Json::UInt64(job.max_rate)).asUInt64();
+
+        if (job.share.empty() || job.remote_path.empty() || job.local_path.empty()) {
+            throw std::runtime_error("Job needs share, remote and local paths");
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
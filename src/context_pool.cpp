@@ -0,0 +1,282 @@
+// context_pool.cpp
+#include "context_pool.hpp"
+#include "metrics.hpp"
+#include <samba-4.0/libsmbclient.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+ContextLease::ContextLease(ContextLease&& other) noexcept
+    : pool_(other.pool_), key_(std::move(other.key_)), ctx_(other.ctx_), fresh_(other.fresh_),
+      broken_(other.broken_), timeout_limited_(other.timeout_limited_) {
+    other.pool_ = nullptr;
+    other.ctx_ = nullptr;
+}
+
+ContextLease& ContextLease::operator=(ContextLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        key_ = std::move(other.key_);
+        ctx_ = other.ctx_;
+        fresh_ = other.fresh_;
+        broken_ = other.broken_;
+        timeout_limited_ = other.timeout_limited_;
+        other.pool_ = nullptr;
+        other.ctx_ = nullptr;
+    }
+    return *this;
+}
+
+ContextLease::~ContextLease() {
+    release();
+}
+
+void ContextLease::limit_timeout(int timeout_ms) {
+    if (!pool_ || !ctx_) return;
+    smbc_setTimeout(ctx_, std::max(1, std::min(timeout_ms, pool_->options_.smb_timeout_ms)));
+    timeout_limited_ = true;
+}
+
+void ContextLease::release() {
+    if (pool_ && ctx_) {
+        if (timeout_limited_ && !broken_) {
+            smbc_setTimeout(ctx_, pool_->options_.smb_timeout_ms);
+        }
+        pool_->release(key_, ctx_, broken_);
+    }
+    pool_ = nullptr;
+    ctx_ = nullptr;
+}
+
+void SmbContextPool::auth_fn(SMBCCTX* ctx, const char* server, const char* share,
+                             char* workgroup, int wgmaxlen,
+                             char* username, int unmaxlen,
+                             char* password, int pwmaxlen) {
+    // 回调里拿不到端口，服务器标签只有主机名
+    Metrics::global().series(SmbOp::Auth, server ? server : "", share ? share : "")
+        .record(OpSeries::Clock::now());
+    auto* self = static_cast<SmbContextPool*>(smbc_getOptionUserData(ctx));
+    strncpy(username, self->credentials_.username.c_str(), unmaxlen-1);
+    strncpy(password, self->credentials_.password.c_str(), pwmaxlen-1);
+    strncpy(workgroup, self->credentials_.workgroup.c_str(), wgmaxlen-1);
+}
+
+SmbContextPool::SmbContextPool(const SmbCredentials& credentials,
+                               const ContextPoolOptions& options)
+    : credentials_(credentials), options_(options), last_sweep_(Clock::now()) {
+    if (options_.max_per_key == 0) options_.max_per_key = 1;
+    if (options_.max_total < options_.max_per_key) options_.max_total = options_.max_per_key;
+}
+
+SmbContextPool::~SmbContextPool() {
+    for (auto& kv : buckets_) {
+        for (auto& e : kv.second.idle) {
+            destroy_context(e.ctx);
+        }
+    }
+}
+
+SMBCCTX* SmbContextPool::create_context() {
+    // 多个线程同时使用各自的上下文前，libsmbclient的全局状态(talloc栈帧、模块初始化)
+    // 必须改用pthread锁保护，只需在第一次创建上下文前调用一次
+    static std::once_flag thread_init;
+    std::call_once(thread_init, smbc_thread_posix);
+
+    SMBCCTX* ctx = smbc_new_context();
+    if (!ctx) {
+        throw std::runtime_error("Failed to create SMB context");
+    }
+
+    smbc_setOptionUserData(ctx, this);
+    smbc_setFunctionAuthDataWithContext(ctx, auth_fn);
+    smbc_setTimeout(ctx, options_.smb_timeout_ms);
+
+    if (!smbc_init_context(ctx)) {
+        smbc_free_context(ctx, 1);
+        throw std::runtime_error("Failed to initialize SMB context");
+    }
+    return ctx;
+}
+
+void SmbContextPool::destroy_context(SMBCCTX* ctx) {
+    if (ctx) {
+        smbc_free_context(ctx, 1);
+    }
+}
+
+bool SmbContextPool::healthy(SMBCCTX* ctx, const std::string& ip, int port,
+                             const std::string& share) {
+    std::string url = "smb://" + ip + ":" + std::to_string(port) + "/" + share;
+    SMBCFILE* dir = smbc_getFunctionOpendir(ctx)(ctx, url.c_str());
+    if (!dir) return false;
+    smbc_getFunctionClosedir(ctx)(ctx, dir);
+    return true;
+}
+
+ContextLease SmbContextPool::acquire(const std::string& ip, int port, const std::string& share) {
+    return do_acquire(ip, port, share, nullptr);
+}
+
+ContextLease SmbContextPool::acquire(const std::string& ip, int port, const std::string& share,
+                                     const TransferControl& control) {
+    return do_acquire(ip, port, share, &control);
+}
+
+ContextLease SmbContextPool::do_acquire(const std::string& ip, int port, const std::string& share,
+                                        const TransferControl* control) {
+    auto start = OpSeries::Clock::now();
+    std::string key = ip + ":" + std::to_string(port) + ":" + share;
+    std::vector<SMBCCTX*> garbage;
+    SMBCCTX* ctx = nullptr;
+    bool check = false;
+    int stopped = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto now = Clock::now();
+        if (now - last_sweep_ > std::chrono::seconds(1)) {
+            collect_idle(now, garbage);
+            last_sweep_ = now;
+        }
+
+        for (;;) {
+            if (control && (stopped = control->stop_reason()) != 0) break;
+            Bucket& bucket = buckets_[key];
+            if (!bucket.idle.empty()) {
+                Entry e = bucket.idle.back();
+                bucket.idle.pop_back();
+                ctx = e.ctx;
+                check = now - e.last_used > std::chrono::milliseconds(options_.health_check_ms);
+                break;
+            }
+            // 先占住名额，在锁外创建上下文
+            if (bucket.total < options_.max_per_key &&
+                (total_ < options_.max_total || steal_idle(key, garbage))) {
+                ++bucket.total;
+                ++total_;
+                break;
+            }
+            if (control) {
+                // 取消不会唤醒等待者，最多等kCancelPoll就检查一次
+                const auto kCancelPoll = std::chrono::milliseconds(50);
+                cv_.wait_until(lock, std::min(Clock::now() + kCancelPoll, control->deadline));
+            } else {
+                cv_.wait(lock);
+            }
+            now = Clock::now();
+        }
+    }
+
+    for (auto* c : garbage) {
+        destroy_context(c);
+    }
+    if (stopped) {
+        Metrics::global().series(SmbOp::Acquire, server_label(ip, port), share)
+            .record(start, 0, stopped);
+        errno = stopped;
+        return ContextLease();
+    }
+
+    if (ctx && check && !healthy(ctx, ip, port, share)) {
+        destroy_context(ctx);
+        ctx = nullptr;
+    }
+    bool fresh = !ctx;
+    if (!ctx) {
+        try {
+            ctx = create_context();
+        } catch (...) {
+            release(key, nullptr, true);
+            throw;
+        }
+    }
+    Metrics::global().series(SmbOp::Acquire, server_label(ip, port), share).record(start);
+    return ContextLease(this, key, ctx, fresh);
+}
+
+void SmbContextPool::release(const std::string& key, SMBCCTX* ctx, bool broken) {
+    SMBCCTX* doomed = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Bucket& bucket = buckets_[key];
+        if (broken || !ctx) {
+            --bucket.total;
+            --total_;
+            doomed = ctx;
+        } else {
+            bucket.idle.push_back({ctx, Clock::now()});
+        }
+    }
+    cv_.notify_all();
+    destroy_context(doomed);
+}
+
+void SmbContextPool::collect_idle(Clock::time_point now, std::vector<SMBCCTX*>& out) {
+    auto limit = std::chrono::milliseconds(options_.idle_timeout_ms);
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+        auto& idle = it->second.idle;
+        // 头部是最早归还的，遇到未超时的即可停止
+        size_t expired = 0;
+        while (expired < idle.size() && now - idle[expired].last_used > limit) {
+            out.push_back(idle[expired].ctx);
+            ++expired;
+        }
+        idle.erase(idle.begin(), idle.begin() + expired);
+        it->second.total -= expired;
+        total_ -= expired;
+
+        if (it->second.total == 0) {
+            it = buckets_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool SmbContextPool::steal_idle(const std::string& except_key, std::vector<SMBCCTX*>& out) {
+    // 全池达到上限时，回收其他服务器最久未用的空闲上下文
+    Bucket* victim = nullptr;
+    for (auto& kv : buckets_) {
+        if (kv.first == except_key || kv.second.idle.empty()) continue;
+        if (!victim || kv.second.idle.front().last_used < victim->idle.front().last_used) {
+            victim = &kv.second;
+        }
+    }
+    if (!victim) return false;
+
+    out.push_back(victim->idle.front().ctx);
+    victim->idle.erase(victim->idle.begin());
+    --victim->total;
+    --total_;
+    return true;
+}
+
+void SmbContextPool::evict_idle() {
+    std::vector<SMBCCTX*> garbage;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_sweep_ = Clock::now();
+        collect_idle(last_sweep_, garbage);
+    }
+    cv_.notify_all();
+    for (auto* c : garbage) {
+        destroy_context(c);
+    }
+}
+
+size_t SmbContextPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_;
+}
+
+size_t SmbContextPool::idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = 0;
+    for (const auto& kv : buckets_) {
+        n += kv.second.idle.size();
+    }
+    return n;
+}
@@ -0,0 +1,610 @@
+// dedup.cpp
+#include "dedup.hpp"
+#include <xxhash.h>
+#include <zstd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint8_t kCodecRaw = 0;
+const uint8_t kCodecZstd = 1;
+const uint64_t kCoalesceGap = 64 << 10;  // 下载时间隔小于该值的块合并成一次读取
+
+double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Gear表：固定种子的splitmix64，保证不同机器、不同版本切分点一致
+const std::array<uint64_t, 256>& gear_table() {
+    static const std::array<uint64_t, 256> table = [] {
+        std::array<uint64_t, 256> t;
+        uint64_t x = 0;
+        for (auto& v : t) {
+            x += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// 取指纹的高bits位；指纹每字节左移一位，高位只受最近64字节影响
+uint64_t top_mask(int bits) {
+    bits = std::max(1, std::min(bits, 63));
+    return ~0ULL << (64 - bits);
+}
+
+ChunkHash hash_chunk(const void* data, size_t len) {
+    XXH128_hash_t h = XXH3_128bits(data, len);
+    return {h.low64, h.high64};
+}
+
+// 本地临时文件，析构时关闭并删除
+struct TempFile {
+    std::string path;
+    int fd = -1;
+
+    TempFile() {
+        std::string tmpl = (fs::temp_directory_path() / "pcn_dedup.XXXXXX").string();
+        fd = mkstemp(&tmpl[0]);
+        if (fd >= 0) path = tmpl;
+    }
+    ~TempFile() {
+        if (fd >= 0) close(fd);
+        if (!path.empty()) unlink(path.c_str());
+    }
+};
+
+bool write_all(int fd, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string random_id() {
+    std::random_device rd;
+    uint64_t id = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^
+                  static_cast<uint64_t>(Clock::now().time_since_epoch().count());
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(id));
+    return buf;
+}
+
+// 索引段："PCNX" 版本 条数，每条为哈希、pack内偏移、存储/原始长度和编码
+bool read_segment(const std::string& path, const std::string& pack,
+                  std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher>& index) {
+    std::ifstream in(path, std::ios::binary);
+    auto get = [&in](void* p, size_t n) { return static_cast<bool>(in.read(static_cast<char*>(p), n)); };
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    if (!get(magic, 4) || memcmp(magic, "PCNX", 4) != 0 || !get(&version, 4) || version != 1 ||
+        !get(&count, 8)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        ChunkHash h;
+        ChunkLocation loc;
+        loc.pack = pack;
+        if (!get(&h.lo, 8) || !get(&h.hi, 8) || !get(&loc.offset, 8) ||
+            !get(&loc.stored_size, 4) || !get(&loc.raw_size, 4) || !get(&loc.codec, 1)) {
+            return false;
+        }
+        index.emplace(h, loc);
+    }
+    return true;
+}
+
+bool write_segment(const std::string& path,
+                   const std::vector<std::pair<ChunkHash, ChunkLocation>>& entries) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto put = [&out](const void* p, size_t n) { out.write(static_cast<const char*>(p), n); };
+    uint32_t version = 1;
+    uint64_t count = entries.size();
+    put("PCNX", 4);
+    put(&version, 4);
+    put(&count, 8);
+    for (const auto& e : entries) {
+        put(&e.first.lo, 8);
+        put(&e.first.hi, 8);
+        put(&e.second.offset, 8);
+        put(&e.second.stored_size, 4);
+        put(&e.second.raw_size, 4);
+        put(&e.second.codec, 1);
+    }
+    return static_cast<bool>(out.flush());
+}
+
+// 本地合并索引："PCNG" 版本 段数，每段为段名、段大小、条数和该段pack里的条目。
+// 把所有已载入的索引段合成一个文件，载入时只打开一次，不随段数增加打开次数
+bool read_merged(const std::string& path,
+                 std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher>& index,
+                 std::unordered_map<std::string, uint64_t>& loaded) {
+    std::ifstream in(path, std::ios::binary);
+    auto get = [&in](void* p, size_t n) { return static_cast<bool>(in.read(static_cast<char*>(p), n)); };
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t segments = 0;
+    if (!get(magic, 4) || memcmp(magic, "PCNG", 4) != 0 || !get(&version, 4) || version != 1 ||
+        !get(&segments, 8)) {
+        return false;
+    }
+    const std::string suffix = ".idx";
+    for (uint64_t s = 0; s < segments; ++s) {
+        uint32_t name_len = 0;
+        uint64_t seg_size = 0;
+        uint64_t count = 0;
+        if (!get(&name_len, 4) || name_len <= suffix.size() || name_len > 4096) return false;
+        std::string name(name_len, '\0');
+        if (!get(&name[0], name_len) || !get(&seg_size, 8) || !get(&count, 8)) return false;
+        std::string pack = name.substr(0, name.size() - suffix.size());
+        for (uint64_t i = 0; i < count; ++i) {
+            ChunkHash h;
+            ChunkLocation loc;
+            loc.pack = pack;
+            if (!get(&h.lo, 8) || !get(&h.hi, 8) || !get(&loc.offset, 8) ||
+                !get(&loc.stored_size, 4) || !get(&loc.raw_size, 4) || !get(&loc.codec, 1)) {
+                return false;
+            }
+            index.emplace(h, loc);
+        }
+        loaded[name] = seg_size;
+    }
+    return true;
+}
+
+bool write_merged(const std::string& path,
+                  const std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher>& index,
+                  const std::unordered_map<std::string, uint64_t>& loaded) {
+    std::unordered_map<std::string, std::vector<const std::pair<const ChunkHash, ChunkLocation>*>> by_pack;
+    for (const auto& e : index) {
+        by_pack[e.second.pack].push_back(&e);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto put = [&out](const void* p, size_t n) { out.write(static_cast<const char*>(p), n); };
+    uint32_t version = 1;
+    uint64_t segments = loaded.size();
+    put("PCNG", 4);
+    put(&version, 4);
+    put(&segments, 8);
+    for (const auto& seg : loaded) {
+        const auto& entries = by_pack[seg.first.substr(0, seg.first.size() - 4)];
+        uint32_t name_len = static_cast<uint32_t>(seg.first.size());
+        uint64_t count = entries.size();
+        put(&name_len, 4);
+        put(seg.first.data(), name_len);
+        put(&seg.second, 8);
+        put(&count, 8);
+        for (const auto* e : entries) {
+            put(&e->first.lo, 8);
+            put(&e->first.hi, 8);
+            put(&e->second.offset, 8);
+            put(&e->second.stored_size, 4);
+            put(&e->second.raw_size, 4);
+            put(&e->second.codec, 1);
+        }
+    }
+    return static_cast<bool>(out.flush());
+}
+
+// 清单："PCNM" 版本 文件大小 块数，每块为哈希和原始长度
+struct ManifestEntry {
+    ChunkHash hash;
+    uint32_t size = 0;
+};
+
+bool write_manifest(const std::string& path, uint64_t file_size,
+                    const std::vector<ManifestEntry>& entries) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto put = [&out](const void* p, size_t n) { out.write(static_cast<const char*>(p), n); };
+    uint32_t version = 1;
+    uint64_t count = entries.size();
+    put("PCNM", 4);
+    put(&version, 4);
+    put(&file_size, 8);
+    put(&count, 8);
+    for (const auto& e : entries) {
+        put(&e.hash.lo, 8);
+        put(&e.hash.hi, 8);
+        put(&e.size, 4);
+    }
+    return static_cast<bool>(out.flush());
+}
+
+bool read_manifest(const std::string& path, uint64_t& file_size,
+                   std::vector<ManifestEntry>& entries) {
+    std::ifstream in(path, std::ios::binary);
+    auto get = [&in](void* p, size_t n) { return static_cast<bool>(in.read(static_cast<char*>(p), n)); };
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    if (!get(magic, 4) || memcmp(magic, "PCNM", 4) != 0 || !get(&version, 4) || version != 1 ||
+        !get(&file_size, 8) || !get(&count, 8)) {
+        return false;
+    }
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        ManifestEntry e;
+        if (!get(&e.hash.lo, 8) || !get(&e.hash.hi, 8) || !get(&e.size, 4)) return false;
+        total += e.size;
+        entries.push_back(e);
+    }
+    return total == file_size;
+}
+
+uint64_t file_size_of(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+}  // namespace
+
+std::vector<uint32_t> cdc_chunks(const uint8_t* data, size_t size, const DedupOptions& options) {
+    const size_t min_size = std::max<size_t>(options.min_chunk, 64);
+    const size_t max_size = std::max(options.max_chunk, min_size);
+    const size_t avg_size = std::min(std::max(options.avg_chunk, min_size), max_size);
+    int bits = 0;
+    while ((size_t(1) << (bits + 1)) <= avg_size) ++bits;
+    // 归一化分块：平均长度之前用更难满足的掩码，之后用更容易的，块长更集中
+    const uint64_t mask_s = top_mask(bits + 2);
+    const uint64_t mask_l = top_mask(bits - 2);
+    const auto& gear = gear_table();
+
+    std::vector<uint32_t> chunks;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t n = std::min(size - pos, max_size);
+        size_t cut = n;
+        if (n > min_size) {
+            const uint8_t* p = data + pos;
+            size_t normal = std::min(avg_size, n);
+            uint64_t fp = 0;
+            size_t i = min_size;
+            for (; i < normal; ++i) {
+                fp = (fp << 1) + gear[p[i]];
+                if (!(fp & mask_s)) break;
+            }
+            if (i == normal) {
+                for (; i < n; ++i) {
+                    fp = (fp << 1) + gear[p[i]];
+                    if (!(fp & mask_l)) break;
+                }
+            }
+            cut = std::min(i + 1, n);
+        }
+        chunks.push_back(static_cast<uint32_t>(cut));
+        pos += cut;
+    }
+    return chunks;
+}
+
+DedupStore::DedupStore(std::shared_ptr<SmbContextPool> pool, const std::string& ip, int port,
+                       const std::string& share, const DedupOptions& options)
+    : client_(std::move(pool)), ip_(ip), port_(port), share_(share), options_(options) {
+    std::string base = options_.cache_dir;
+    if (base.empty()) {
+        const char* xdg = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        base = (xdg && *xdg ? xdg : std::string(home ? home : ".") + "/.cache") + "/pc_neighbor/dedup";
+    }
+    std::string key = ip + "_" + std::to_string(port) + "_" + share;
+    std::replace(key.begin(), key.end(), '/', '_');
+    cache_dir_ = base + "/" + key;
+}
+
+std::string DedupStore::store_path(const std::string& sub) const {
+    return options_.store_dir + "/" + sub;
+}
+
+bool DedupStore::load_index() {
+    std::vector<RemoteEntry> segments;
+    if (!client_.list_dir(ip_, share_, store_path("index"), segments, port_)) {
+        // 共享上还没有块存储
+        index_.clear();
+        loaded_.clear();
+        return client_.last_error() == ENOENT;
+    }
+
+    const std::string suffix = ".idx";
+    std::unordered_map<std::string, uint64_t> listed;
+    for (const auto& seg : segments) {
+        if (seg.is_dir || seg.name.size() <= suffix.size() ||
+            seg.name.compare(seg.name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        listed[seg.name] = seg.size;
+    }
+
+    std::error_code ec;
+    fs::create_directories(cache_dir_, ec);
+    const std::string merged = cache_dir_ + "/index.merged";
+    if (loaded_.empty() && !read_merged(merged, index_, loaded_)) {
+        index_.clear();
+        loaded_.clear();
+    }
+    // 段只会新增，已载入的段消失或大小变了说明块存储被删除重建，之前的条目都不可信
+    for (const auto& seg : loaded_) {
+        auto it = listed.find(seg.first);
+        if (it == listed.end() || it->second != seg.second) {
+            index_.clear();
+            loaded_.clear();
+            merged_dirty_ = true;
+            break;
+        }
+    }
+
+    std::vector<std::string> absorbed;
+    for (const auto& seg : listed) {
+        if (loaded_.count(seg.first)) continue;
+        std::string pack = seg.first.substr(0, seg.first.size() - suffix.size());
+        std::string cached = cache_dir_ + "/" + seg.first;
+
+        // 索引段写入后不再修改，缓存里有且大小一致就不必再下载
+        if (file_size_of(cached) != seg.second || !read_segment(cached, pack, index_)) {
+            std::string tmp = cached + ".tmp";
+            if (!client_.download(ip_, share_, store_path("index/" + seg.first), tmp, port_) ||
+                rename(tmp.c_str(), cached.c_str()) != 0 || !read_segment(cached, pack, index_)) {
+                unlink(tmp.c_str());
+                unlink(cached.c_str());
+                return false;
+            }
+        }
+        loaded_[seg.first] = seg.second;
+        absorbed.push_back(cached);
+        merged_dirty_ = true;
+    }
+
+    // 合并索引写入失败不影响本次结果，下次仍从单独的段文件载入
+    if (save_merged()) {
+        for (const auto& path : absorbed) {
+            unlink(path.c_str());
+        }
+    }
+    return true;
+}
+
+bool DedupStore::save_merged() {
+    if (!merged_dirty_) return true;
+    const std::string merged = cache_dir_ + "/index.merged";
+    std::string tmp = merged + ".tmp";
+    if (!write_merged(tmp, index_, loaded_) || rename(tmp.c_str(), merged.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    merged_dirty_ = false;
+    return true;
+}
+
+bool DedupStore::upload(const std::string& local_path, const std::string& remote_path) {
+    stats_ = DedupStats();
+    auto start = Clock::now();
+    if (!load_index()) return false;
+
+    int fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    const uint8_t* data = nullptr;
+    if (size > 0) {
+        void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(m, size, MADV_SEQUENTIAL);
+        data = static_cast<const uint8_t*>(m);
+    }
+    close(fd);
+
+    // 切块、哈希，只压缩并写入共享上没有的块
+    TempFile pack;
+    std::string pack_id = random_id();
+    std::vector<ManifestEntry> manifest;
+    // 本次新写入的块只记在这里，pack和索引段都上传成功后才并入index_，
+    // 失败时index_里不会留下指向不存在pack的条目
+    std::vector<std::pair<ChunkHash, ChunkLocation>> added;
+    Index pending;
+    std::vector<char> buf(ZSTD_compressBound(std::max(options_.max_chunk, options_.min_chunk)));
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    bool ok = pack.fd >= 0 && cctx != nullptr;
+
+    uint64_t offset = 0;
+    size_t pos = 0;
+    for (uint32_t len : ok ? cdc_chunks(data, size, options_) : std::vector<uint32_t>()) {
+        const uint8_t* chunk = data + pos;
+        pos += len;
+        ChunkHash h = hash_chunk(chunk, len);
+        manifest.push_back({h, len});
+        if (index_.count(h) || pending.count(h)) continue;
+
+        ChunkLocation loc;
+        loc.pack = pack_id;
+        loc.offset = offset;
+        loc.raw_size = len;
+        const void* stored = chunk;
+        size_t stored_size = len;
+        size_t z = ZSTD_compressCCtx(cctx, buf.data(), buf.size(), chunk, len, options_.zstd_level);
+        if (!ZSTD_isError(z) && z < len) {
+            stored = buf.data();
+            stored_size = z;
+            loc.codec = kCodecZstd;
+        } else {
+            loc.codec = kCodecRaw;
+        }
+        loc.stored_size = static_cast<uint32_t>(stored_size);
+        if (!write_all(pack.fd, stored, stored_size)) {
+            ok = false;
+            break;
+        }
+        offset += stored_size;
+        pending.emplace(h, loc);
+        added.emplace_back(h, loc);
+        stats_.new_bytes += len;
+        stats_.stored_bytes += stored_size;
+    }
+    ZSTD_freeCCtx(cctx);
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+
+    stats_.logical_bytes = size;
+    stats_.chunks = manifest.size();
+    stats_.new_chunks = added.size();
+    if (!ok) return false;
+
+    // 先pack再索引段，最后清单：清单可见时它引用的块一定已经可读。
+    // 索引段先以.part上传再改名，其他客户端列目录时不会读到写了一半的段
+    if (!added.empty()) {
+        TempFile segment;
+        if (segment.fd < 0 || !write_segment(segment.path, added)) return false;
+        std::string segment_path = store_path("index/" + pack_id + ".idx");
+        if (!client_.make_dir(ip_, share_, options_.store_dir, port_) ||
+            !client_.make_dir(ip_, share_, store_path("packs"), port_) ||
+            !client_.make_dir(ip_, share_, store_path("index"), port_) ||
+            !client_.upload(ip_, share_, pack.path, store_path("packs/" + pack_id + ".pack"), port_) ||
+            !client_.upload(ip_, share_, segment.path, segment_path + ".part", port_)) {
+            return false;
+        }
+        if (!client_.rename_remote(ip_, share_, segment_path + ".part", segment_path, port_)) {
+            client_.remove_remote(ip_, share_, segment_path + ".part", port_);
+            return false;
+        }
+        stats_.sent_bytes += offset + file_size_of(segment.path);
+
+        // 新段直接并入index_和合并索引，下次load_index不必再读它
+        index_.insert(pending.begin(), pending.end());
+        loaded_[pack_id + ".idx"] = file_size_of(segment.path);
+        merged_dirty_ = true;
+        std::error_code ec;
+        fs::create_directories(cache_dir_, ec);
+        save_merged();
+    }
+
+    TempFile manifest_file;
+    if (manifest_file.fd < 0 || !write_manifest(manifest_file.path, size, manifest) ||
+        !client_.upload(ip_, share_, manifest_file.path, remote_path + kManifestSuffix, port_)) {
+        return false;
+    }
+    stats_.sent_bytes += file_size_of(manifest_file.path);
+    stats_.seconds = since(start);
+    return true;
+}
+
+bool DedupStore::download(const std::string& remote_path, const std::string& local_path) {
+    stats_ = DedupStats();
+    auto start = Clock::now();
+
+    TempFile manifest_file;
+    uint64_t size = 0;
+    std::vector<ManifestEntry> manifest;
+    if (manifest_file.fd < 0 ||
+        !client_.download(ip_, share_, remote_path + kManifestSuffix, manifest_file.path, port_) ||
+        !read_manifest(manifest_file.path, size, manifest) || !load_index()) {
+        return false;
+    }
+    stats_.sent_bytes += file_size_of(manifest_file.path);
+
+    // 按pack收集需要的区间，间隔小的相邻块合并成一次读取
+    std::map<std::string, std::vector<std::pair<uint64_t, uint64_t>>> extents;
+    for (const auto& e : manifest) {
+        auto it = index_.find(e.hash);
+        if (it == index_.end()) return false;
+        const ChunkLocation& loc = it->second;
+        extents[loc.pack].emplace_back(loc.offset, loc.offset + loc.stored_size);
+    }
+
+    // 每个pack读入一个稀疏临时文件的相同偏移处
+    std::map<std::string, std::unique_ptr<TempFile>> packs;
+    for (auto& kv : extents) {
+        auto& ranges = kv.second;
+        std::sort(ranges.begin(), ranges.end());
+        auto file = std::unique_ptr<TempFile>(new TempFile());
+        if (file->fd < 0) return false;
+
+        std::string path = store_path("packs/" + kv.first + ".pack");
+        for (size_t i = 0; i < ranges.size();) {
+            uint64_t begin = ranges[i].first;
+            uint64_t end = ranges[i].second;
+            for (++i; i < ranges.size() && ranges[i].first <= end + kCoalesceGap; ++i) {
+                end = std::max(end, ranges[i].second);
+            }
+            if (!client_.read_range(ip_, share_, path, file->fd, begin, end - begin, port_)) {
+                return false;
+            }
+            stats_.sent_bytes += end - begin;
+        }
+        packs[kv.first] = std::move(file);
+    }
+
+    // 按清单顺序解压、校验并写出
+    std::string tmp = local_path + ".pcntmp";
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return false;
+    std::vector<char> stored;
+    std::vector<char> raw;
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    bool ok = dctx != nullptr;
+
+    for (const auto& e : manifest) {
+        if (!ok) break;
+        const ChunkLocation& loc = index_.at(e.hash);
+        stored.resize(loc.stored_size);
+        if (pread(packs[loc.pack]->fd, stored.data(), loc.stored_size, loc.offset) !=
+            static_cast<ssize_t>(loc.stored_size)) {
+            ok = false;
+            break;
+        }
+        const char* chunk = stored.data();
+        if (loc.codec == kCodecZstd) {
+            raw.resize(loc.raw_size);
+            size_t n = ZSTD_decompressDCtx(dctx, raw.data(), raw.size(), stored.data(), stored.size());
+            if (ZSTD_isError(n) || n != loc.raw_size) {
+                ok = false;
+                break;
+            }
+            chunk = raw.data();
+        } else if (loc.codec != kCodecRaw || loc.stored_size != loc.raw_size) {
+            ok = false;
+            break;
+        }
+        ok = loc.raw_size == e.size && hash_chunk(chunk, loc.raw_size) == e.hash &&
+             write_all(out, chunk, loc.raw_size);
+    }
+    ZSTD_freeDCtx(dctx);
+
+    if (close(out) != 0) ok = false;
+    if (ok) ok = rename(tmp.c_str(), local_path.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+
+    stats_.logical_bytes = size;
+    stats_.chunks = manifest.size();
+    stats_.seconds = since(start);
+    return ok;
+}
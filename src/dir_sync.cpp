@@ -0,0 +1,455 @@
+// dir_sync.cpp
+#include "dir_sync.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct LocalFile {
+    uint64_t size;
+    int64_t mtime;
+};
+
+struct SyncTask {
+    std::string path;  // 相对路径
+    uint64_t size;
+    int64_t mtime;     // Pull时为远端mtime，Push时为本地mtime
+};
+
+std::string join(const std::string& a, const std::string& b) {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    return a + "/" + b;
+}
+
+double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 64位内容哈希，按8字节字混合，只用于判断本地文件内容是否变化
+uint64_t content_hash(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint64_t total = 0;
+    std::vector<char> buf(1 << 20);
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0) {
+        size_t i = 0;
+        for (; i + 8 <= static_cast<size_t>(n); i += 8) {
+            uint64_t w;
+            memcpy(&w, buf.data() + i, 8);
+            h = (h ^ w) * k;
+            h ^= h >> 31;
+        }
+        for (; i < static_cast<size_t>(n); ++i) {
+            h = (h ^ static_cast<unsigned char>(buf[i])) * k;
+        }
+        total += static_cast<uint64_t>(n);
+    }
+    close(fd);
+    h ^= total;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+bool stat_local(const std::string& path, LocalFile& file) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    file.size = st.st_size;
+    file.mtime = st.st_mtim.tv_sec;
+    return true;
+}
+
+bool is_sync_artifact(const std::string& rel, const std::string& index_name) {
+    auto ends_with = [&rel](const char* suffix) {
+        size_t n = strlen(suffix);
+        return rel.size() >= n && rel.compare(rel.size() - n, n, suffix) == 0;
+    };
+    return rel == index_name || rel == index_name + ".tmp" ||
+           ends_with(".pcnpart") || ends_with(".pcnup");
+}
+
+}  // namespace
+
+DirectorySync::DirectorySync(std::shared_ptr<SmbContextPool> pool, const SyncOptions& options)
+    : pool_(pool ? std::move(pool) : std::make_shared<SmbContextPool>()), options_(options) {}
+
+bool DirectorySync::walk_remote(const std::string& ip, int port, const std::string& share,
+                                const std::string& remote_root,
+                                std::unordered_map<std::string, RemoteEntry>& files,
+                                std::vector<std::string>& dirs) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> queue = {""};
+    size_t active = 0;
+    bool failed = false;
+
+    auto worker = [&]() {
+        SambaClient client(pool_);
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            cv.wait(lock, [&] { return !queue.empty() || active == 0 || failed; });
+            if (failed || (queue.empty() && active == 0)) break;
+
+            std::string rel = std::move(queue.front());
+            queue.pop_front();
+            ++active;
+            lock.unlock();
+
+            std::vector<RemoteEntry> entries;
+            bool ok = false;
+            try {
+                ok = client.list_dir(ip, share, join(remote_root, rel), entries, port);
+            } catch (const std::exception&) {
+            }
+
+            lock.lock();
+            --active;
+            if (!ok) {
+                failed = true;
+            } else {
+                for (auto& e : entries) {
+                    std::string path = join(rel, e.name);
+                    if (e.is_dir) {
+                        dirs.push_back(path);
+                        queue.push_back(path);
+                    } else {
+                        files.emplace(std::move(path), std::move(e));
+                    }
+                }
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int w = 0; w < std::max(options_.walkers, 1); ++w) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    return !failed;
+}
+
+// 索引格式：魔数、版本、同步目标，之后是定长字段+路径的记录。
+// 长度和条数都按文件大小检查，损坏或截断的索引返回false，由调用方重新建立
+bool DirectorySync::load_index(const std::string& path, const std::string& target, Index& index) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    const uint64_t kEntryFixed = 4 + 8 + 8 + 8 + 8;  // 路径长度 + 四个定长字段
+    const uint32_t kMaxPath = 4096;
+    in.seekg(0);
+
+    auto get = [&in](void* p, size_t n) { return static_cast<bool>(in.read(static_cast<char*>(p), n)); };
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t len = 0;
+    if (!get(magic, 4) || memcmp(magic, "PCNI", 4) != 0 || !get(&version, 4) || version != 1 ||
+        !get(&len, 4) || len != target.size()) {
+        return false;
+    }
+    std::string stored(len, '\0');
+    uint64_t count = 0;
+    if (!get(&stored[0], len) || stored != target || !get(&count, 8) ||
+        count > file_size / kEntryFixed) {
+        return false;
+    }
+
+    index.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        SyncIndexEntry e;
+        if (!get(&len, 4) || len > kMaxPath) {
+            index.clear();
+            return false;
+        }
+        std::string rel(len, '\0');
+        if (!get(&rel[0], len) || !get(&e.size, 8) || !get(&e.remote_mtime, 8) ||
+            !get(&e.local_mtime, 8) || !get(&e.hash, 8)) {
+            index.clear();
+            return false;
+        }
+        index.emplace(std::move(rel), e);
+    }
+    return true;
+}
+
+bool DirectorySync::save_index(const std::string& path, const std::string& target,
+                               const Index& index) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        auto put = [&out](const void* p, size_t n) { out.write(static_cast<const char*>(p), n); };
+        uint32_t version = 1;
+        uint32_t len = static_cast<uint32_t>(target.size());
+        uint64_t count = index.size();
+        put("PCNI", 4);
+        put(&version, 4);
+        put(&len, 4);
+        put(target.data(), len);
+        put(&count, 8);
+        for (const auto& kv : index) {
+            len = static_cast<uint32_t>(kv.first.size());
+            put(&len, 4);
+            put(kv.first.data(), len);
+            put(&kv.second.size, 8);
+            put(&kv.second.remote_mtime, 8);
+            put(&kv.second.local_mtime, 8);
+            put(&kv.second.hash, 8);
+        }
+        if (!out.flush()) return false;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool DirectorySync::sync(const std::string& ip, int port, const std::string& share,
+                         const std::string& remote_root, const std::string& local_root) {
+    stats_ = SyncStats();
+    const bool pull = options_.direction == SyncDirection::Pull;
+    const std::string target = std::string(pull ? "pull " : "push ") + "smb://" + ip + ":" +
+                               std::to_string(port) + "/" + join(share, remote_root);
+
+    std::error_code ec;
+    if (pull) {
+        fs::create_directories(local_root, ec);
+    }
+    std::string index_path = join(local_root, options_.index_name);
+    Index index;
+    load_index(index_path, target, index);
+
+    // 阶段1：遍历。远端遍历失败时直接返回，避免把读不到的目录误判为已删除；
+    // 只有Push且远端根目录本身不存在(ENOENT)时才当作空目录创建
+    auto walk_start = Clock::now();
+    SambaClient client(pool_);
+    std::unordered_map<std::string, RemoteEntry> remote_files;
+    std::vector<std::string> remote_dirs;
+    if (!walk_remote(ip, port, share, remote_root, remote_files, remote_dirs)) {
+        RemoteEntry root;
+        if (pull || remote_root.empty() || client.stat_remote(ip, share, remote_root, root, port) ||
+            client.last_error() != ENOENT || !client.make_dir(ip, share, remote_root, port)) {
+            return false;
+        }
+        remote_files.clear();
+        remote_dirs.clear();
+    }
+    stats_.dirs = remote_dirs.size();
+
+    std::unordered_map<std::string, LocalFile> local_files;
+    if (!pull) {
+        for (auto it = fs::recursive_directory_iterator(local_root, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec)) continue;
+            std::string rel = fs::relative(it->path(), local_root, ec).generic_string();
+            LocalFile file;
+            if (!is_sync_artifact(rel, options_.index_name) && stat_local(it->path().string(), file)) {
+                local_files.emplace(std::move(rel), file);
+            }
+        }
+        if (ec) return false;
+    }
+    stats_.walk_seconds = since(walk_start);
+
+    // 阶段2：与索引比较，得到需要传输的文件
+    std::vector<SyncTask> tasks;
+    if (pull) {
+        for (const auto& kv : remote_files) {
+            const RemoteEntry& r = kv.second;
+            auto it = index.find(kv.first);
+            LocalFile local;
+            if (it != index.end() && it->second.size == r.size &&
+                it->second.remote_mtime == r.mtime &&
+                stat_local(join(local_root, kv.first), local) &&
+                local.size == r.size && local.mtime == it->second.local_mtime) {
+                ++stats_.skipped;
+                continue;
+            }
+            tasks.push_back({kv.first, r.size, r.mtime});
+        }
+        stats_.files = remote_files.size();
+
+        if (options_.delete_extraneous) {
+            for (auto it = index.begin(); it != index.end();) {
+                if (remote_files.count(it->first)) {
+                    ++it;
+                    continue;
+                }
+                if (unlink(join(local_root, it->first).c_str()) == 0) ++stats_.deleted;
+                it = index.erase(it);
+            }
+        }
+
+        for (const auto& d : remote_dirs) {
+            fs::create_directories(join(local_root, d), ec);
+        }
+    } else {
+        for (const auto& kv : local_files) {
+            const LocalFile& l = kv.second;
+            auto it = index.find(kv.first);
+            auto rit = remote_files.find(kv.first);
+            if (it != index.end() && rit != remote_files.end() &&
+                rit->second.size == it->second.size &&
+                rit->second.mtime == it->second.remote_mtime && l.size == it->second.size) {
+                if (l.mtime == it->second.local_mtime) {
+                    ++stats_.skipped;
+                    continue;
+                }
+                // 只是mtime变化(如touch)，内容哈希一致时不重传
+                if (options_.use_hash && it->second.hash != 0 &&
+                    content_hash(join(local_root, kv.first)) == it->second.hash) {
+                    it->second.local_mtime = l.mtime;
+                    ++stats_.skipped;
+                    continue;
+                }
+            }
+            tasks.push_back({kv.first, l.size, l.mtime});
+        }
+        stats_.files = local_files.size();
+
+        if (options_.delete_extraneous) {
+            for (auto it = index.begin(); it != index.end();) {
+                if (local_files.count(it->first)) {
+                    ++it;
+                    continue;
+                }
+                if (remote_files.count(it->first) &&
+                    client.remove_remote(ip, share, join(remote_root, it->first), port)) {
+                    ++stats_.deleted;
+                }
+                it = index.erase(it);
+            }
+        }
+
+        // 按字典序创建缺失的远端目录，父目录总在子目录之前
+        std::set<std::string> missing;
+        std::set<std::string> existing(remote_dirs.begin(), remote_dirs.end());
+        for (const auto& t : tasks) {
+            for (size_t slash = t.path.find('/'); slash != std::string::npos;
+                 slash = t.path.find('/', slash + 1)) {
+                std::string dir = t.path.substr(0, slash);
+                if (!existing.count(dir)) missing.insert(dir);
+            }
+        }
+        for (const auto& d : missing) {
+            client.make_dir(ip, share, join(remote_root, d), port);
+        }
+    }
+
+    // 阶段3：多个连接并发传输，小文件不再逐个串行往返
+    auto transfer_start = Clock::now();
+    std::atomic<size_t> next{0};
+    std::mutex index_mutex;
+    // 定期保存：传输线程在index_mutex内只记录变更，到期的线程在锁外把变更合入
+    // snapshot再写盘，写索引期间其他线程照常传输
+    struct IndexChange {
+        std::string path;
+        bool ok;
+        SyncIndexEntry entry;
+    };
+    std::vector<IndexChange> changes;
+    std::mutex save_mutex;
+    Index snapshot = tasks.empty() ? Index() : index;
+    auto last_save = Clock::now();
+
+    auto worker = [&]() {
+        SambaClient c(pool_);
+        TransferControl control;
+        control.flow = options_.flow;
+        c.set_control(control);
+        for (size_t i = next++; i < tasks.size(); i = next++) {
+            const SyncTask& t = tasks[i];
+            std::string local = join(local_root, t.path);
+            std::string remote = join(remote_root, t.path);
+            SyncIndexEntry entry;
+            bool ok = false;
+            try {
+                if (pull) {
+                    ok = c.download(ip, share, remote, local, port);
+                    if (ok) {
+                        // 本地mtime与远端一致，下次比较时不依赖本地时钟
+                        struct timespec times[2] = {{0, UTIME_OMIT}, {t.mtime, 0}};
+                        utimensat(AT_FDCWD, local.c_str(), times, 0);
+                        entry = {t.size, t.mtime, t.mtime, 0};
+                    }
+                } else {
+                    RemoteEntry re;
+                    ok = c.upload(ip, share, local, remote, port) &&
+                         c.stat_remote(ip, share, remote, re, port);
+                    if (ok) {
+                        entry = {t.size, re.mtime, t.mtime,
+                                 options_.use_hash ? content_hash(local) : 0};
+                    }
+                }
+            } catch (const std::exception&) {
+                ok = false;
+            }
+
+            bool save_due = false;
+            {
+                std::lock_guard<std::mutex> lock(index_mutex);
+                if (ok) {
+                    index[t.path] = entry;
+                    ++stats_.transferred;
+                    stats_.bytes += t.size;
+                } else {
+                    index.erase(t.path);
+                    ++stats_.failed;
+                }
+                changes.push_back({t.path, ok, entry});
+                if (Clock::now() - last_save >= std::chrono::milliseconds(options_.index_save_ms)) {
+                    last_save = Clock::now();
+                    save_due = true;
+                }
+            }
+            // 定期保存，中断后已完成的文件不再重传；save_mutex保证变更按顺序合入
+            if (save_due) {
+                std::lock_guard<std::mutex> save_lock(save_mutex);
+                std::vector<IndexChange> batch;
+                {
+                    std::lock_guard<std::mutex> lock(index_mutex);
+                    batch.swap(changes);
+                }
+                for (auto& ch : batch) {
+                    if (ch.ok) {
+                        snapshot[ch.path] = ch.entry;
+                    } else {
+                        snapshot.erase(ch.path);
+                    }
+                }
+                save_index(index_path, target, snapshot);
+            }
+        }
+    };
+
+    size_t workers = std::min<size_t>(std::max(options_.transfers, 1), tasks.size());
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    stats_.transfer_seconds = since(transfer_start);
+
+    bool saved = save_index(index_path, target, index);
+    return saved && stats_.failed == 0;
+}
@@ -0,0 +1,291 @@
+// discovery.cpp
+#include "discovery.hpp"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// 受RLIMIT_NOFILE约束的并发上限，预留一部分fd给SMB上下文和日志
+static size_t effective_inflight(int max_inflight) {
+    size_t cap = max_inflight > 0 ? static_cast<size_t>(max_inflight) : 1;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        size_t limit = rl.rlim_cur > 128 ? rl.rlim_cur - 64 : rl.rlim_cur / 2;
+        cap = std::min(cap, std::max<size_t>(limit, 1));
+    }
+    return cap;
+}
+
+// 探测成功的连接直接RST关闭，避免成千上万个TIME_WAIT
+static void close_abort(int fd) {
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
+
+std::vector<ProbeTarget> probe_tcp(const std::vector<ProbeTarget>& targets,
+                                   int timeout_ms, int max_inflight) {
+    const size_t n = targets.size();
+    const size_t cap = effective_inflight(max_inflight);
+    const auto timeout = std::chrono::milliseconds(std::max(timeout_ms, 1));
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+
+    std::vector<int> fds(n, -1);
+    std::vector<Clock::time_point> deadlines(n);
+    std::vector<char> accepted(n, 0);
+    std::deque<size_t> started;  // 按发起顺序排列，截止时间单调递增
+    size_t next = 0;
+    size_t inflight = 0;
+
+    auto finish = [&](size_t i, bool ok) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, fds[i], nullptr);
+        if (ok) {
+            close_abort(fds[i]);
+            accepted[i] = 1;
+        } else {
+            close(fds[i]);
+        }
+        fds[i] = -1;
+        --inflight;
+    };
+
+    while (next < n || inflight > 0) {
+        // 在并发上限内发起新的connect
+        while (next < n && inflight < cap) {
+            const ProbeTarget& t = targets[next];
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(t.port));
+            if (inet_pton(AF_INET, t.ip.c_str(), &addr.sin_addr) != 1) {
+                ++next;
+                continue;
+            }
+
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                // fd耗尽时先等已发起的探测完成
+                if (inflight > 0) break;
+                ++next;
+                continue;
+            }
+
+            size_t i = next++;
+            if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                close_abort(fd);
+                accepted[i] = 1;
+                continue;
+            }
+            if (errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+
+            epoll_event ev{};
+            ev.events = EPOLLOUT;
+            ev.data.u64 = i;
+            if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+            fds[i] = fd;
+            deadlines[i] = Clock::now() + timeout;
+            started.push_back(i);
+            ++inflight;
+        }
+
+        if (inflight == 0) continue;
+
+        while (!started.empty() && fds[started.front()] < 0) started.pop_front();
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadlines[started.front()] - Clock::now()).count() + 1;
+
+        epoll_event events[256];
+        int k = epoll_wait(ep, events, 256, static_cast<int>(std::max<long long>(wait, 0)));
+        if (k < 0 && errno != EINTR) {
+            for (int fd : fds) {
+                if (fd >= 0) close(fd);
+            }
+            close(ep);
+            throw std::runtime_error("epoll_wait failed");
+        }
+
+        for (int e = 0; e < k; ++e) {
+            size_t i = static_cast<size_t>(events[e].data.u64);
+            if (fds[i] < 0) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &len);
+            finish(i, err == 0);
+        }
+
+        // 关闭已超时的探测
+        auto now = Clock::now();
+        while (!started.empty()) {
+            size_t i = started.front();
+            if (fds[i] >= 0) {
+                if (deadlines[i] > now) break;
+                finish(i, false);
+            }
+            started.pop_front();
+        }
+    }
+
+    close(ep);
+
+    std::vector<ProbeTarget> open;
+    for (size_t i = 0; i < n; ++i) {
+        if (accepted[i]) open.push_back(targets[i]);
+    }
+    return open;
+}
+
+void cidr_range(const std::string& spec, uint32_t& first, uint32_t& last) {
+    size_t slash = spec.find('/');
+    in_addr base;
+    int prefix = slash == std::string::npos ? 32 : -1;
+    if (slash != std::string::npos) {
+        try {
+            prefix = std::stoi(spec.substr(slash + 1));
+        } catch (const std::exception&) {
+        }
+    }
+    if (prefix < 8 || prefix > 32 ||
+        inet_pton(AF_INET, spec.substr(0, slash).c_str(), &base) != 1) {
+        throw std::runtime_error("Invalid CIDR: " + spec);
+    }
+
+    uint32_t mask = prefix == 32 ? 0xffffffffu : ~(0xffffffffu >> prefix);
+    first = ntohl(base.s_addr) & mask;
+    last = first | ~mask;
+    // /31和/32没有网络地址和广播地址之分
+    if (prefix < 31) {
+        ++first;
+        --last;
+    }
+}
+
+std::vector<std::string> expand_cidr(const std::string& spec) {
+    if (spec.find('/') == std::string::npos) {
+        return {spec};
+    }
+
+    uint32_t first = 0;
+    uint32_t last = 0;
+    cidr_range(spec, first, last);
+
+    std::vector<std::string> ips;
+    ips.reserve(last - first + 1);
+    char buf[INET_ADDRSTRLEN];
+    for (uint64_t a = first; a <= last; ++a) {
+        in_addr addr;
+        addr.s_addr = htonl(static_cast<uint32_t>(a));
+        inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+        ips.push_back(buf);
+    }
+    return ips;
+}
+
+DiscoveryEngine::DiscoveryEngine(const DiscoveryOptions& options,
+                                 std::shared_ptr<SmbContextPool> pool)
+    : options_(options), pool_(pool ? std::move(pool) : std::make_shared<SmbContextPool>()) {}
+
+std::vector<int> DiscoveryEngine::default_ports() {
+    std::vector<int> ports = {445, 139};
+    for (int i = 4455; i <= 4464; i++) {
+        ports.push_back(i);
+    }
+    return ports;
+}
+
+std::vector<SambaService> DiscoveryEngine::discover(const std::vector<std::string>& ips,
+                                                    const std::vector<int>& ports) {
+    std::vector<ProbeTarget> targets;
+    targets.reserve(ips.size() * ports.size());
+    for (const auto& ip : ips) {
+        for (int port : ports) {
+            targets.push_back({ip, port});
+        }
+    }
+    return discover(targets);
+}
+
+std::vector<SambaService> DiscoveryEngine::discover(const std::vector<ProbeTarget>& targets) {
+    return list_open(probe(targets));
+}
+
+std::vector<ProbeTarget> DiscoveryEngine::probe(const std::vector<ProbeTarget>& targets) {
+    stats_ = DiscoveryStats();
+    stats_.probed = targets.size();
+
+    // 阶段1：非阻塞TCP探测
+    auto t0 = Clock::now();
+    std::vector<ProbeTarget> open = probe_tcp(targets, options_.connect_timeout_ms,
+                                              options_.max_inflight);
+    stats_.probe_ms = elapsed_ms(t0);
+    stats_.open = open.size();
+    return open;
+}
+
+std::vector<SambaService> DiscoveryEngine::list_open(const std::vector<ProbeTarget>& open) {
+    // 阶段2：只对开放端口做SMB握手和列共享，工作线程从共享池借用上下文
+    auto t1 = Clock::now();
+    std::vector<SambaService> found(open.size());
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        try {
+            SambaClient client(pool_);
+            for (size_t i = next++; i < open.size(); i = next++) {
+                found[i] = {open[i].ip, open[i].port,
+                            client.list_shares(open[i].ip, open[i].port)};
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    size_t workers = std::min<size_t>(std::max(options_.smb_workers, 1), open.size());
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    stats_.smb_ms = elapsed_ms(t1);
+
+    std::vector<SambaService> results;
+    for (auto& s : found) {
+        if (!s.shares.empty()) {
+            results.push_back(std::move(s));
+        }
+    }
+    stats_.services = results.size();
+    return results;
+}
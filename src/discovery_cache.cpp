@@ -0,0 +1,290 @@
+// discovery_cache.cpp
+#include "discovery_cache.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+namespace {
+
+const uint32_t kCacheVersion = 1;
+
+// 在mmap出来的只读内存上顺序解析，越界时ok置为false
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T v{};
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    std::string str() {
+        uint32_t len = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - p) < len) {
+            ok = false;
+            return std::string();
+        }
+        std::string s(p, len);
+        p += len;
+        return s;
+    }
+};
+
+struct Writer {
+    std::string buf;
+
+    template <typename T>
+    void put(T v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(T)); }
+
+    void str(const std::string& s) {
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        buf += s;
+    }
+};
+
+bool valid_mac(const std::string& mac) {
+    return !mac.empty() && mac != "00:00:00:00:00:00";
+}
+
+}  // namespace
+
+DiscoveryCache::DiscoveryCache(const std::string& path, const DiscoveryCacheOptions& options)
+    : path_(path), options_(options) {}
+
+std::string DiscoveryCache::key(const std::string& ip, int port) {
+    return ip + ":" + std::to_string(port);
+}
+
+int64_t DiscoveryCache::now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string DiscoveryCache::default_path() {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    std::string base = xdg && *xdg ? xdg : std::string(home ? home : ".") + "/.cache";
+    return base + "/pc_neighbor/discovery.cache";
+}
+
+bool DiscoveryCache::load() {
+    services_.clear();
+    devices_.clear();
+
+    int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 8) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    Reader r{static_cast<const char*>(data), static_cast<const char*>(data) + st.st_size};
+    bool ok = memcmp(r.p, "PCND", 4) == 0;
+    r.p += 4;
+    ok = ok && r.get<uint32_t>() == kCacheVersion;
+
+    uint64_t n_services = ok ? r.get<uint64_t>() : 0;
+    for (uint64_t i = 0; ok && r.ok && i < n_services; ++i) {
+        ServiceRecord rec;
+        rec.service.ip = r.str();
+        rec.service.port = r.get<int32_t>();
+        rec.checked_at = r.get<int64_t>();
+        uint32_t n_shares = r.get<uint32_t>();
+        for (uint32_t j = 0; r.ok && j < n_shares; ++j) {
+            SambaShare share;
+            share.name = r.str();
+            share.path = r.str();
+            rec.service.shares.push_back(share);
+        }
+        services_[key(rec.service.ip, rec.service.port)] = std::move(rec);
+    }
+
+    uint64_t n_devices = ok && r.ok ? r.get<uint64_t>() : 0;
+    for (uint64_t i = 0; ok && r.ok && i < n_devices; ++i) {
+        DeviceRecord rec;
+        rec.device.name = r.str();
+        rec.device.ip = r.str();
+        rec.device.mac = r.str();
+        rec.seen_at = r.get<int64_t>();
+        devices_[rec.device.ip] = rec;
+    }
+
+    munmap(data, st.st_size);
+    if (!ok || !r.ok) {
+        services_.clear();
+        devices_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool DiscoveryCache::save() const {
+    Writer w;
+    w.buf = "PCND";
+    w.put<uint32_t>(kCacheVersion);
+    w.put<uint64_t>(services_.size());
+    for (const auto& kv : services_) {
+        const SambaService& s = kv.second.service;
+        w.str(s.ip);
+        w.put<int32_t>(s.port);
+        w.put<int64_t>(kv.second.checked_at);
+        w.put<uint32_t>(static_cast<uint32_t>(s.shares.size()));
+        for (const auto& share : s.shares) {
+            w.str(share.name);
+            w.str(share.path);
+        }
+    }
+    w.put<uint64_t>(devices_.size());
+    for (const auto& kv : devices_) {
+        w.str(kv.second.device.name);
+        w.str(kv.second.device.ip);
+        w.str(kv.second.device.mac);
+        w.put<int64_t>(kv.second.seen_at);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path_).parent_path(), ec);
+    std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.write(w.buf.data(), w.buf.size()).flush()) return false;
+    }
+    return rename(tmp.c_str(), path_.c_str()) == 0;
+}
+
+std::vector<SambaService> DiscoveryCache::services() const {
+    std::vector<SambaService> result;
+    for (const auto& kv : services_) {
+        result.push_back(kv.second.service);
+    }
+    return result;
+}
+
+std::vector<SambaService> DiscoveryCache::services(const std::vector<std::string>& ips) const {
+    std::set<std::string> wanted(ips.begin(), ips.end());
+    std::vector<SambaService> result;
+    for (const auto& kv : services_) {
+        if (wanted.count(kv.second.service.ip)) result.push_back(kv.second.service);
+    }
+    return result;
+}
+
+std::vector<DeviceInfo> DiscoveryCache::devices() const {
+    std::vector<DeviceInfo> result;
+    for (const auto& kv : devices_) {
+        result.push_back(kv.second.device);
+    }
+    return result;
+}
+
+bool DiscoveryCache::fresh(const ProbeTarget& target, int64_t now) const {
+    auto it = services_.find(key(target.ip, target.port));
+    return it != services_.end() && now - it->second.checked_at < options_.service_ttl_s;
+}
+
+void DiscoveryCache::update_services(const std::vector<ProbeTarget>& probed,
+                                     const std::vector<ProbeTarget>& open,
+                                     const std::vector<SambaService>& found, int64_t now) {
+    std::set<std::string> open_keys;
+    for (const auto& t : open) {
+        open_keys.insert(key(t.ip, t.port));
+    }
+    for (const auto& t : probed) {
+        if (!open_keys.count(key(t.ip, t.port))) {
+            services_.erase(key(t.ip, t.port));
+        }
+    }
+
+    for (const auto& s : found) {
+        ServiceRecord& rec = services_[key(s.ip, s.port)];
+        rec.service = s;
+        rec.checked_at = now;
+    }
+    // 开放但这次SMB没列出共享(不是Samba或认证失败)的旧记录
+    for (const auto& t : open) {
+        if (!fresh(t, now)) {
+            services_.erase(key(t.ip, t.port));
+        }
+    }
+}
+
+void DiscoveryCache::update_devices(const std::vector<DeviceInfo>& devices, int64_t now) {
+    for (const auto& d : devices) {
+        if (!valid_mac(d.mac)) continue;
+
+        DeviceRecord& rec = devices_[d.ip];
+        if (valid_mac(rec.device.mac) && rec.device.mac != d.mac) {
+            // IP换了主机，之前的服务记录不再可信
+            for (auto& kv : services_) {
+                if (kv.second.service.ip == d.ip) kv.second.checked_at = 0;
+            }
+        }
+        std::string name = rec.device.name;
+        rec.device = d;
+        if (d.name.empty() || d.name == "Unknown") {
+            rec.device.name = name.empty() ? d.name : name;
+        }
+        rec.seen_at = now;
+    }
+
+    for (auto it = devices_.begin(); it != devices_.end();) {
+        if (now - it->second.seen_at > options_.device_ttl_s) {
+            it = devices_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<SambaService> revalidate(DiscoveryEngine& engine, DiscoveryCache& cache,
+                                     const std::vector<std::string>& ips,
+                                     const std::vector<int>& ports) {
+    std::vector<ProbeTarget> targets;
+    targets.reserve(ips.size() * ports.size());
+    for (const auto& ip : ips) {
+        for (int port : ports) {
+            targets.push_back({ip, port});
+        }
+    }
+    return revalidate_open(engine, cache, targets, engine.probe(targets));
+}
+
+std::vector<SambaService> revalidate_open(DiscoveryEngine& engine, DiscoveryCache& cache,
+                                          const std::vector<ProbeTarget>& probed,
+                                          const std::vector<ProbeTarget>& open) {
+    int64_t now = DiscoveryCache::now();
+    // 只读ARP缓存：每次启动和后台刷新都不应向整个网段广播
+    cache.update_devices(NetworkScanner().read_arp_cache(), now);
+
+    std::vector<ProbeTarget> changed;
+    for (const auto& t : open) {
+        if (!cache.fresh(t, now)) changed.push_back(t);
+    }
+
+    std::vector<SambaService> found = engine.list_open(changed);
+    cache.update_services(probed, open, found, now);
+
+    std::set<std::string> hosts;
+    for (const auto& t : probed) hosts.insert(t.ip);
+    for (const auto& t : open) hosts.insert(t.ip);
+    return cache.services(std::vector<std::string>(hosts.begin(), hosts.end()));
+}
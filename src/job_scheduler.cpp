@@ -0,0 +1,204 @@
+// job_scheduler.cpp
+#include "job_scheduler.hpp"
+#include "samba_client.hpp"
+#include "parallel_transfer.hpp"
+#include "metrics.hpp"
+#include "bandwidth.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct ReadyJob {
+    int priority;
+    size_t id;
+    int attempts;
+
+    // priority_queue取最大者：优先级高的先出，同优先级按提交顺序
+    bool operator<(const ReadyJob& other) const {
+        if (priority != other.priority) return priority < other.priority;
+        return id > other.id;
+    }
+};
+
+struct DelayedJob {
+    Clock::time_point not_before;
+    ReadyJob job;
+
+    bool operator<(const DelayedJob& other) const { return not_before > other.not_before; }
+};
+
+struct ServerQueue {
+    int limit = 1;
+    int running = 0;
+    std::priority_queue<ReadyJob> ready;
+};
+
+std::string server_key(const ServerConfig& s) {
+    return s.ip + ":" + std::to_string(s.port);
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+JobScheduler::JobScheduler(std::shared_ptr<SmbContextPool> pool, const SchedulerOptions& options)
+    : pool_(pool ? std::move(pool) : std::make_shared<SmbContextPool>()), options_(options) {}
+
+void JobScheduler::submit(const TransferJob& job) {
+    jobs_.push_back(job);
+}
+
+int JobScheduler::backoff_for(int attempt) const {
+    long long delay = options_.backoff_ms;
+    for (int i = 1; i < attempt && delay < options_.max_backoff_ms; ++i) {
+        delay *= 2;
+    }
+    delay = std::min<long long>(delay, options_.max_backoff_ms);
+    // ±25%抖动，避免同一服务器上的失败任务同时重试
+    thread_local std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(0.75, 1.25);
+    return static_cast<int>(delay * jitter(rng));
+}
+
+JobResult JobScheduler::execute(const TransferJob& job) {
+    JobResult result;
+    result.job = job;
+    auto start = Clock::now();
+    try {
+        const ServerConfig& s = job.server;
+        auto flow = std::make_shared<TransferFlow>(job.weight, job.max_rate);
+        if (job.parallel) {
+            ParallelOptions options;
+            options.flow = flow;
+            ParallelTransfer transfer(options, pool_);
+            result.ok = job.type == JobType::Download
+                ? transfer.download(s.ip, job.share, job.remote_path, job.local_path, s.port)
+                : transfer.upload(s.ip, job.share, job.local_path, job.remote_path, s.port);
+            result.bytes = transfer.stats().bytes;
+        } else {
+            SambaClient client(pool_);
+            TransferControl control;
+            control.flow = flow;
+            client.set_control(control);
+            result.ok = job.type == JobType::Download
+                ? client.download(s.ip, job.share, job.remote_path, job.local_path, s.port)
+                : client.upload(s.ip, job.share, job.local_path, job.remote_path, s.port);
+            result.bytes = client.last_transfer().bytes;
+        }
+    } catch (const std::exception&) {
+        result.ok = false;
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+std::vector<JobResult> JobScheduler::run() {
+    std::vector<JobResult> results(jobs_.size());
+    std::map<std::string, ServerQueue> servers;
+    std::priority_queue<DelayedJob> delayed;
+    std::vector<double> latencies;
+    size_t remaining = jobs_.size();
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    stats_ = SchedulerStats();
+    for (size_t id = 0; id < jobs_.size(); ++id) {
+        ServerQueue& q = servers[server_key(jobs_[id].server)];
+        q.limit = std::max(q.limit, jobs_[id].server.max_concurrency);
+        q.ready.push({jobs_[id].priority, id, 0});
+    }
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining > 0) {
+            // 到期的重试任务回到各自服务器的就绪队列
+            auto now = Clock::now();
+            while (!delayed.empty() && delayed.top().not_before <= now) {
+                const ReadyJob& job = delayed.top().job;
+                servers[server_key(jobs_[job.id].server)].ready.push(job);
+                delayed.pop();
+            }
+
+            // 在未达并发上限的服务器中选优先级最高的任务
+            ServerQueue* best = nullptr;
+            for (auto& kv : servers) {
+                ServerQueue& q = kv.second;
+                if (q.running >= q.limit || q.ready.empty()) continue;
+                if (!best || best->ready.top() < q.ready.top()) best = &q;
+            }
+
+            if (!best) {
+                if (delayed.empty()) {
+                    cv.wait(lock);
+                } else {
+                    cv.wait_until(lock, delayed.top().not_before);
+                }
+                continue;
+            }
+
+            ReadyJob job = best->ready.top();
+            best->ready.pop();
+            ++best->running;
+            ++job.attempts;
+
+            lock.unlock();
+            JobResult result = execute(jobs_[job.id]);
+            lock.lock();
+
+            --best->running;
+            result.attempts = job.attempts;
+            if (result.ok) {
+                latencies.push_back(result.seconds * 1000);
+                stats_.bytes += result.bytes;
+            }
+            if (!result.ok && job.attempts <= jobs_[job.id].max_retries) {
+                ++stats_.retries;
+                const TransferJob& failed = jobs_[job.id];
+                Metrics::global().add_retry(server_label(failed.server.ip, failed.server.port),
+                                            failed.share);
+                delayed.push({Clock::now() + std::chrono::milliseconds(backoff_for(job.attempts)), job});
+            } else {
+                results[job.id] = result;
+                --remaining;
+            }
+            cv.notify_all();
+        }
+    };
+
+    auto start = Clock::now();
+    size_t workers = std::min<size_t>(std::max(options_.workers, 1), std::max<size_t>(jobs_.size(), 1));
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    stats_.wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const auto& r : results) {
+        if (r.ok) {
+            ++stats_.succeeded;
+        } else {
+            ++stats_.failed;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    stats_.p50_ms = percentile(latencies, 0.50);
+    stats_.p95_ms = percentile(latencies, 0.95);
+    stats_.max_ms = latencies.empty() ? 0 : latencies.back();
+    return results;
+}
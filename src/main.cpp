@@ -1,33 +1,35 @@
 #include "scanner.hpp"
 #include "samba_client.hpp"
+#include "discovery.hpp"
+#include "parallel_transfer.hpp"
+#include "config.hpp"
+#include "job_scheduler.hpp"
+#include "dir_sync.hpp"
+#include "discovery_cache.hpp"
+#include "mdns_browser.hpp"
+#include "metrics.hpp"
+#include "async_client.hpp"
+#include "dedup.hpp"
+#include "bandwidth.hpp"
+#include <algorithm>
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <vector>
 #include <map>
+#include <future>
+#include <chrono>
+#include <csignal>
+#include <cstring>
 
 using namespace std;
 
-struct SambaService {
-    string ip;
-    int port;
-    vector<SambaShare> shares;
-};
-
-void scan_all_ports(SambaClient& client, const string& ip, vector<SambaService>& results) {
-    // 标准Samba端口 + 4455-4464
-    vector<int> ports_to_scan = {445, 139};
-    for (int i = 4455; i <= 4464; i++) {
-        ports_to_scan.push_back(i);
-    }
-
-    for (int port : ports_to_scan) {
-        if (client.check_samba(ip, port)) {
-            auto shares = client.list_shares(ip, port);
-            if (!shares.empty()) {
-                results.push_back({ip, port, shares});
-            }
-        }
-    }
+void print_discovery_stats(const DiscoveryStats& stats) {
+    cout << fixed << setprecision(1)
+         << "探测 " << stats.probed << " 个端口, " << stats.open << " 个开放, "
+         << stats.services << " 个Samba服务 (TCP探测 " << stats.probe_ms
+         << " ms, SMB握手 " << stats.smb_ms << " ms)\n";
+    cout.unsetf(ios::fixed);
 }
 
 void print_services(const vector<SambaService>& services) {
@@ -58,8 +60,54 @@ void print_services(const vector<SambaService>& services) {
     }
 }
 
-void perform_operation(SambaClient& client, const SambaService& service) {
-    cout << "\n选择操作:\n1. 下载文件\n2. 上传文件\n选择(1/2): ";
+void print_transfer_stats(const TransferStats& stats) {
+    cout << fixed << setprecision(2)
+         << stats.bytes << " 字节, 耗时 " << stats.seconds << " s, "
+         << stats.bytes_per_sec() / (1024 * 1024) << " MiB/s\n";
+    cout.unsetf(ios::fixed);
+}
+
+// 传输进行中时Ctrl-C只取消当前传输，不退出程序
+static atomic<atomic<bool>*> g_cancel_flag{nullptr};
+
+void on_interrupt(int) {
+    if (atomic<bool>* flag = g_cancel_flag.load()) flag->store(true);
+}
+
+// 提交异步传输，等待期间刷新进度
+AsyncStatus run_with_progress(const function<future<AsyncStatus>(const TransferControl&)>& start) {
+    struct Progress {
+        atomic<uint64_t> done{0};
+        atomic<uint64_t> total{0};
+    };
+    auto progress = make_shared<Progress>();
+    TransferControl control;
+    // 交互传输权重高于批量任务和目录同步，共享带宽不足时先走
+    control.flow = make_shared<TransferFlow>(8);
+    control.progress = [progress](uint64_t done, uint64_t total) {
+        progress->done = done;
+        progress->total = total;
+    };
+
+    g_cancel_flag = control.cancel.flag();
+    auto previous = signal(SIGINT, on_interrupt);
+    future<AsyncStatus> result = start(control);
+    while (result.wait_for(chrono::milliseconds(200)) != future_status::ready) {
+        uint64_t done = progress->done, total = progress->total;
+        cout << "\r已传输 " << done / (1024 * 1024) << " MiB";
+        if (total > 0) {
+            cout << " / " << total / (1024 * 1024) << " MiB (" << done * 100 / total << "%)";
+        }
+        cout << ", Ctrl-C取消" << flush;
+    }
+    signal(SIGINT, previous);
+    g_cancel_flag = nullptr;
+    cout << "\r" << string(60, ' ') << "\r";
+    return result.get();
+}
+
+void perform_operation(SambaClient& client, AsyncSambaClient& async, const SambaService& service) {
+    cout << "\n选择操作:\n1. 下载文件\n2. 上传文件\n3. 多流并行下载(可续传)\n4. 多流并行上传(可续传)\n5. 同步目录到本地\n6. 同步本地目录到共享\n7. 去重压缩上传\n8. 下载去重上传的文件\n9. 设置带宽限制\n选择(1-9): ";
     int action;
     cin >> action;
     cin.ignore();
@@ -71,10 +119,15 @@ void perform_operation(SambaClient& client, const SambaService& service) {
         cout << "输入本地保存路径: ";
         getline(cin, local_path);
 
-        if (client.download(service.ip, service.shares[0].name, remote_path, local_path)) {
+        AsyncStatus status = run_with_progress([&](const TransferControl& control) {
+            return async.download_async(service.ip, service.shares[0].name, remote_path,
+                                        local_path, service.port, control);
+        });
+        if (status.ok) {
             cout << "下载成功!\n";
+            print_transfer_stats(status.stats);
         } else {
-            cout << "下载失败!\n";
+            cout << "下载失败: " << strerror(status.error) << "\n";
         }
     } else if (action == 2) {
         cout << "输入本地文件路径: ";
@@ -82,30 +135,326 @@ void perform_operation(SambaClient& client, const SambaService& service) {
         cout << "输入远程保存路径(相对共享目录): ";
         getline(cin, remote_path);
 
-        if (client.upload(service.ip, service.shares[0].name, local_path, remote_path)) {
+        AsyncStatus status = run_with_progress([&](const TransferControl& control) {
+            return async.upload_async(service.ip, service.shares[0].name, local_path,
+                                      remote_path, service.port, control);
+        });
+        if (status.ok) {
             cout << "上传成功!\n";
+            print_transfer_stats(status.stats);
+        } else {
+            cout << "上传失败: " << strerror(status.error) << "\n";
+        }
+    } else if (action == 3 || action == 4) {
+        ParallelTransfer transfer(ParallelOptions(), client.context_pool());
+        bool ok;
+        if (action == 3) {
+            cout << "输入远程文件路径(相对共享目录): ";
+            getline(cin, remote_path);
+            cout << "输入本地保存路径: ";
+            getline(cin, local_path);
+            ok = transfer.download(service.ip, service.shares[0].name, remote_path, local_path,
+                                   service.port);
+        } else {
+            cout << "输入本地文件路径: ";
+            getline(cin, local_path);
+            cout << "输入远程保存路径(相对共享目录): ";
+            getline(cin, remote_path);
+            ok = transfer.upload(service.ip, service.shares[0].name, local_path, remote_path,
+                                 service.port);
+        }
+
+        if (ok) {
+            cout << "传输成功!\n";
+            print_transfer_stats(transfer.stats());
         } else {
-            cout << "上传失败!\n";
+            cout << "传输未完成，再次执行相同操作可从断点续传\n";
         }
+    } else if (action == 5 || action == 6) {
+        cout << "输入远程目录(相对共享目录，留空为根目录): ";
+        getline(cin, remote_path);
+        cout << "输入本地目录: ";
+        getline(cin, local_path);
+
+        SyncOptions options;
+        options.direction = action == 5 ? SyncDirection::Pull : SyncDirection::Push;
+        DirectorySync sync(client.context_pool(), options);
+        bool ok = sync.sync(service.ip, service.port, service.shares[0].name,
+                            remote_path, local_path);
+
+        const SyncStats& stats = sync.stats();
+        cout << fixed << setprecision(2)
+             << "文件 " << stats.files << ", 传输 " << stats.transferred
+             << ", 未变化 " << stats.skipped << ", 失败 " << stats.failed
+             << ", 删除 " << stats.deleted << "\n"
+             << "遍历 " << stats.walk_seconds << " s, 传输 " << stats.bytes << " 字节 "
+             << stats.transfer_seconds << " s\n";
+        cout.unsetf(ios::fixed);
+        cout << (ok ? "同步完成!\n" : "同步未完成!\n");
+    } else if (action == 7 || action == 8) {
+        DedupStore store(client.context_pool(), service.ip, service.port, service.shares[0].name);
+        bool ok;
+        if (action == 7) {
+            cout << "输入本地文件路径: ";
+            getline(cin, local_path);
+            cout << "输入远程保存路径(相对共享目录): ";
+            getline(cin, remote_path);
+            ok = store.upload(local_path, remote_path);
+        } else {
+            cout << "输入远程文件路径(相对共享目录，不含" << DedupStore::kManifestSuffix << "): ";
+            getline(cin, remote_path);
+            cout << "输入本地保存路径: ";
+            getline(cin, local_path);
+            ok = store.download(remote_path, local_path);
+        }
+
+        const DedupStats& stats = store.stats();
+        cout << fixed << setprecision(2)
+             << "文件 " << stats.logical_bytes << " 字节, 块 " << stats.chunks
+             << ", 新块 " << stats.new_chunks << " (" << stats.new_bytes << " -> "
+             << stats.stored_bytes << " 字节)\n"
+             << "网络传输 " << stats.sent_bytes << " 字节, 用时 " << stats.seconds << " s\n";
+        cout.unsetf(ios::fixed);
+        cout << (ok ? "传输成功!\n" : "传输失败!\n");
+    } else if (action == 9) {
+        BandwidthLimiter& limiter = BandwidthLimiter::global();
+        string server = server_label(service.ip, service.port);
+        double global_mib, server_mib;
+        cout << "全局限速(MiB/s，0不限，当前 " << limiter.global_rate() / 1048576.0 << "): ";
+        cin >> global_mib;
+        cout << server << " 限速(MiB/s，0不限，当前 " << limiter.server_rate(server) / 1048576.0
+             << "): ";
+        cin >> server_mib;
+        cin.ignore();
+        limiter.set_global_rate(static_cast<uint64_t>(max(global_mib, 0.0) * 1048576));
+        limiter.set_server_rate(server, static_cast<uint64_t>(max(server_mib, 0.0) * 1048576));
+        cout << "已生效，正在进行的传输也按新限速\n";
+    }
+}
+
+// 配置文件中的全局和每服务器限速
+void apply_bandwidth(const AppConfig& config) {
+    BandwidthLimiter& limiter = BandwidthLimiter::global();
+    limiter.set_global_rate(config.max_rate);
+    for (const auto& s : config.servers) {
+        if (s.max_rate > 0) limiter.set_server_rate(server_label(s.ip, s.port), s.max_rate);
     }
 }
 
-int main() {
+// 非交互批量模式：并发执行任务列表，输出汇总统计，全部成功返回0
+int run_batch(const AppConfig& config, const string& jobs_path,
+              const shared_ptr<SmbContextPool>& pool) {
+    SchedulerOptions options;
+    options.workers = config.workers;
+    JobScheduler scheduler(pool, options);
+    for (const auto& job : load_jobs(jobs_path, config)) {
+        scheduler.submit(job);
+    }
+
+    vector<JobResult> results = scheduler.run();
+    for (const auto& r : results) {
+        if (!r.ok) {
+            cerr << "失败: " << (r.job.type == JobType::Download ? "下载 " : "上传 ")
+                 << r.job.server.ip << ":" << r.job.server.port << "/" << r.job.share << "/"
+                 << r.job.remote_path << " (尝试 " << r.attempts << " 次)\n";
+        }
+    }
+
+    const SchedulerStats& stats = scheduler.stats();
+    cout << fixed << setprecision(2)
+         << "任务: " << results.size() << ", 成功 " << stats.succeeded
+         << ", 失败 " << stats.failed << ", 重试 " << stats.retries << "\n"
+         << "总量: " << stats.bytes << " 字节, 耗时 " << stats.wall_seconds << " s, "
+         << stats.bytes_per_sec() / (1024 * 1024) << " MiB/s\n"
+         << "单次传输耗时: p50 " << stats.p50_ms << " ms, p95 " << stats.p95_ms
+         << " ms, max " << stats.max_ms << " ms\n";
+    return stats.failed == 0 ? 0 : 1;
+}
+
+void print_devices(const vector<DeviceInfo>& devices) {
+    cout << "\n发现 " << devices.size() << " 台设备:\n";
+    cout << left << setw(18) << "IP地址" << setw(20) << "MAC地址" << "名称\n";
+    cout << string(50, '-') << endl;
+    for (const auto& d : devices) {
+        cout << left << setw(18) << d.ip << setw(20) << d.mac << d.name << endl;
+    }
+}
+
+// --devices的mDNS浏览窗口：ARP扫描结束得早时补足到这么久，响应通常在几百毫秒内到达
+const int kMdnsWindowMs = 1000;
+
+// 后台浏览mDNS广播，avahi-daemon不可用时返回false，只靠主动探测
+bool start_mdns(MdnsBrowser& mdns) {
     try {
-        SambaClient client;
-        vector<string> ips = {"127.0.0.1"}; // 可以添加更多IP
-        vector<SambaService> found_services;
+        mdns.start();
+        return true;
+    } catch (const exception& e) {
+        cerr << "mDNS不可用: " << e.what() << endl;
+        return false;
+    }
+}
+
+// 写出指标快照(.json为JSON，否则Prometheus文本)和追踪文件，路径为空时跳过
+void dump_metrics(const string& metrics_path, const string& trace_path) {
+    if (!metrics_path.empty() && !Metrics::global().write(metrics_path)) {
+        cerr << "写入指标失败: " << metrics_path << endl;
+    }
+    if (!trace_path.empty() && !Metrics::global().write_trace(trace_path)) {
+        cerr << "写入追踪失败: " << trace_path << endl;
+    }
+}
 
-        cout << "正在扫描Samba服务..." << endl;
-        
-        for (const auto& ip : ips) {
-            scan_all_ports(client, ip, found_services);
+void print_usage(const char* prog) {
+    cerr << "用法: " << prog << " [--config config.json] [--no-cache] [IP或网段...]\n"
+         << "      " << prog << " [--config config.json] --batch jobs.json\n"
+         << "      " << prog << " --devices [网段] | --pcap arp.pcap\n"
+         << "通用选项: --metrics metrics.prom|metrics.json  --trace trace.json\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        string config_path = "config.json";
+        string jobs_path;
+        string cache_path = DiscoveryCache::default_path();
+        string metrics_path;
+        string trace_path;
+        bool list_devices = false;
+        ArpScanOptions arp_options;
+        vector<string> targets;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if ((arg == "--config" || arg == "--batch") && i + 1 < argc) {
+                (arg == "--config" ? config_path : jobs_path) = argv[++i];
+            } else if ((arg == "--metrics" || arg == "--trace") && i + 1 < argc) {
+                (arg == "--metrics" ? metrics_path : trace_path) = argv[++i];
+            } else if (arg == "--no-cache") {
+                cache_path.clear();
+            } else if (arg == "--devices") {
+                list_devices = true;
+            } else if (arg == "--pcap" && i + 1 < argc) {
+                arp_options.replay_file = argv[++i];
+                list_devices = true;
+            } else if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else if (arg[0] == '-') {
+                print_usage(argv[0]);
+                return 2;
+            } else {
+                targets.push_back(arg);
+            }
+        }
+
+        if (!trace_path.empty()) {
+            Metrics::global().enable_tracing();
+        }
+
+        if (list_devices) {
+            // 参数中的网段作为ARP扫描范围
+            if (!targets.empty()) {
+                arp_options.subnet = targets[0];
+            }
+            // ARP扫描期间同时收集mDNS广播，用实例名代替"Unknown"
+            MdnsBrowser mdns;
+            bool browsing = start_mdns(mdns);
+            NetworkScanner scanner(arp_options);
+            vector<DeviceInfo> devices = scanner.scan();
+            const ArpSweepStats& sweep = scanner.last_sweep();
+            if (sweep.truncated()) {
+                cerr << "ARP扫描未覆盖整个网段: 已探测 " << sweep.sent << " / " << sweep.targets
+                     << " 个地址，可指定更小的网段\n";
+            }
+            if (browsing) apply_names(devices, mdns.wait(kMdnsWindowMs));
+            print_devices(devices);
+            return 0;
         }
 
+        // 交互模式下配置文件可选，批量模式必须存在
+        AppConfig config;
+        if (!jobs_path.empty() || ifstream(config_path)) {
+            config = load_config(config_path);
+        }
+        apply_bandwidth(config);
+        auto pool = make_shared<SmbContextPool>(config.credentials);
+
+        if (!jobs_path.empty()) {
+            int rc = run_batch(config, jobs_path, pool);
+            dump_metrics(metrics_path, trace_path);
+            return rc;
+        }
+
+        SambaClient client(pool);
+        AsyncSambaClient async_client(pool);
+        // 命令行可传入IP或网段(如 192.168.1.0/24)，默认扫描本机
+        vector<string> ips;
+        for (const auto& target : targets) {
+            for (const auto& ip : expand_cidr(target)) {
+                ips.push_back(ip);
+            }
+        }
+        if (ips.empty()) {
+            ips.push_back("127.0.0.1");
+        }
+
+        DiscoveryEngine engine(DiscoveryOptions(), pool);
+        // 浏览_smb._tcp与TCP探测同时进行：广播过的服务直接列共享，
+        // 不在ips里的广播服务也一并加入结果
+        MdnsBrowser mdns;
+        start_mdns(mdns);
+        DiscoveryCache cache(cache_path);
+        vector<SambaService> found_services;
+        if (!cache_path.empty() && cache.load()) {
+            found_services = cache.services(ips);
+        }
+        // 不先等mDNS：探测开始时已收到广播的目标跳过探测，探测结束即停止浏览，
+        // 探测期间到达的广播目标并入同一次SMB阶段，统计完整
+        auto discover_all = [&]() {
+            vector<ProbeTarget> targets;
+            for (const auto& ip : ips) {
+                for (int port : DiscoveryEngine::default_ports()) {
+                    targets.push_back({ip, port});
+                }
+            }
+            vector<ProbeTarget> probed = without_advertised(targets, mdns.records());
+            vector<ProbeTarget> open = engine.probe(probed);
+            mdns.stop();
+            add_advertised(open, mdns.records());
+            if (cache_path.empty()) {
+                return engine.list_open(open);
+            }
+            vector<SambaService> services = revalidate_open(engine, cache, probed, open);
+            cache.save();
+            return services;
+        };
+
+        // 有缓存时立即显示，后台浏览并只对变化的主机重新探测；
+        // future最后声明、最先析构，退出时先等刷新完成再释放engine和连接池
+        future<vector<SambaService>> refreshed;
+        if (!found_services.empty()) {
+            cout << "使用缓存的发现结果，后台重新验证中..." << endl;
+            refreshed = async(launch::async, discover_all);
+        } else {
+            cout << "正在扫描Samba服务..." << endl;
+            found_services = discover_all();
+            print_discovery_stats(engine.stats());
+        }
         print_services(found_services);
 
         if (!found_services.empty()) {
             while (true) {
+                if (refreshed.valid() &&
+                    refreshed.wait_for(chrono::seconds(0)) == future_status::ready) {
+                    try {
+                        found_services = refreshed.get();
+                        cout << "\n发现结果已更新: ";
+                        print_discovery_stats(engine.stats());
+                        print_services(found_services);
+                        if (found_services.empty()) break;
+                    } catch (const exception& e) {
+                        cerr << "后台刷新失败: " << e.what() << endl;
+                    }
+                }
+
                 cout << "\n输入要操作的服务ID(1-" << found_services.size() 
                      << ")，或0退出: ";
                 int choice;
@@ -118,9 +467,12 @@ int main() {
                     continue;
                 }
 
-                perform_operation(client, found_services[choice-1]);
+                perform_operation(client, async_client, found_services[choice-1]);
+                pool->evict_idle();
+                dump_metrics(metrics_path, trace_path);
             }
         }
+        dump_metrics(metrics_path, trace_path);
 
     } catch (const exception& e) {
         cerr << "错误: " << e.what() << endl;
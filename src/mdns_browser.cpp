@@ -0,0 +1,229 @@
+// mdns_browser.cpp
+#include "mdns_browser.hpp"
+#include <avahi-client/client.h>
+#include <avahi-client/lookup.h>
+#include <avahi-common/thread-watch.h>
+#include <avahi-common/malloc.h>
+#include <avahi-common/error.h>
+#include <avahi-common/address.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const char* const kSmbType = "_smb._tcp";
+const char* const kDeviceInfoType = "_device-info._tcp";
+
+// Avahi的回调都在threaded poll线程中执行
+class AvahiBackend : public MdnsBackend {
+public:
+    ~AvahiBackend() override { stop(); }
+
+    void start(const std::vector<std::string>& types, Callback callback) override {
+        stop();
+        callback_ = std::move(callback);
+
+        poll_ = avahi_threaded_poll_new();
+        if (!poll_) {
+            throw std::runtime_error("Failed to create Avahi poll");
+        }
+        int error = 0;
+        client_ = avahi_client_new(avahi_threaded_poll_get(poll_), static_cast<AvahiClientFlags>(0),
+                                   client_cb, this, &error);
+        if (!client_) {
+            avahi_threaded_poll_free(poll_);
+            poll_ = nullptr;
+            throw std::runtime_error(std::string("Avahi client: ") + avahi_strerror(error));
+        }
+
+        for (const auto& type : types) {
+            AvahiServiceBrowser* b = avahi_service_browser_new(
+                client_, AVAHI_IF_UNSPEC, AVAHI_PROTO_INET, type.c_str(), nullptr,
+                static_cast<AvahiLookupFlags>(0), browse_cb, this);
+            if (b) browsers_.push_back(b);
+        }
+        if (browsers_.empty() || avahi_threaded_poll_start(poll_) < 0) {
+            std::string reason = avahi_strerror(avahi_client_errno(client_));
+            stop();
+            throw std::runtime_error("Avahi browser: " + reason);
+        }
+        started_ = true;
+    }
+
+    void stop() override {
+        if (!poll_) return;
+        if (started_) {
+            avahi_threaded_poll_stop(poll_);
+            started_ = false;
+        }
+        for (auto* b : browsers_) {
+            avahi_service_browser_free(b);
+        }
+        browsers_.clear();
+        // 释放client会一并释放尚未完成的resolver
+        avahi_client_free(client_);
+        client_ = nullptr;
+        avahi_threaded_poll_free(poll_);
+        poll_ = nullptr;
+    }
+
+private:
+    static void client_cb(AvahiClient*, AvahiClientState, void*) {}
+
+    static void browse_cb(AvahiServiceBrowser* b, AvahiIfIndex interface, AvahiProtocol protocol,
+                          AvahiBrowserEvent event, const char* name, const char* type,
+                          const char* domain, AvahiLookupResultFlags, void* userdata) {
+        if (event != AVAHI_BROWSER_NEW) return;
+        auto* self = static_cast<AvahiBackend*>(userdata);
+        avahi_service_resolver_new(avahi_service_browser_get_client(b), interface, protocol,
+                                   name, type, domain, AVAHI_PROTO_INET,
+                                   static_cast<AvahiLookupFlags>(0), resolve_cb, self);
+    }
+
+    static void resolve_cb(AvahiServiceResolver* r, AvahiIfIndex, AvahiProtocol,
+                           AvahiResolverEvent event, const char* name, const char* type,
+                           const char*, const char* host_name, const AvahiAddress* address,
+                           uint16_t port, AvahiStringList* txt, AvahiLookupResultFlags,
+                           void* userdata) {
+        auto* self = static_cast<AvahiBackend*>(userdata);
+        if (event == AVAHI_RESOLVER_FOUND && self->callback_) {
+            MdnsRecord record;
+            record.type = type;
+            record.service_name = name;
+            record.host_name = host_name;
+            record.port = port;
+
+            char ip[AVAHI_ADDRESS_STR_MAX];
+            avahi_address_snprint(ip, sizeof(ip), address);
+            record.ip = ip;
+
+            if (AvahiStringList* item = avahi_string_list_find(txt, "model")) {
+                char* key = nullptr;
+                char* value = nullptr;
+                if (avahi_string_list_get_pair(item, &key, &value, nullptr) == 0 && value) {
+                    record.model = value;
+                }
+                avahi_free(key);
+                avahi_free(value);
+            }
+            self->callback_(record);
+        }
+        avahi_service_resolver_free(r);
+    }
+
+    AvahiThreadedPoll* poll_ = nullptr;
+    AvahiClient* client_ = nullptr;
+    std::vector<AvahiServiceBrowser*> browsers_;
+    Callback callback_;
+    bool started_ = false;
+};
+
+}  // namespace
+
+std::unique_ptr<MdnsBackend> make_avahi_backend() {
+    return std::unique_ptr<MdnsBackend>(new AvahiBackend());
+}
+
+MdnsBrowser::MdnsBrowser(std::unique_ptr<MdnsBackend> backend)
+    : backend_(backend ? std::move(backend) : make_avahi_backend()) {}
+
+MdnsBrowser::~MdnsBrowser() {
+    stop();
+}
+
+void MdnsBrowser::start(MdnsBackend::Callback callback) {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records_.clear();
+        callback_ = std::move(callback);
+    }
+    started_at_ = std::chrono::steady_clock::now();
+    backend_->start({kSmbType, kDeviceInfoType}, [this](const MdnsRecord& record) {
+        MdnsBackend::Callback cb;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            records_.push_back(record);
+            cb = callback_;
+        }
+        if (cb) cb(record);
+    });
+    running_ = true;
+}
+
+void MdnsBrowser::stop() {
+    if (running_) {
+        backend_->stop();
+        running_ = false;
+    }
+}
+
+std::vector<MdnsRecord> MdnsBrowser::records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+std::vector<MdnsRecord> MdnsBrowser::wait(int window_ms) {
+    if (running_) {
+        std::this_thread::sleep_until(started_at_ + std::chrono::milliseconds(window_ms));
+        stop();
+    }
+    return records();
+}
+
+std::vector<MdnsRecord> MdnsBrowser::browse(int timeout_ms) {
+    start();
+    return wait(timeout_ms);
+}
+
+std::vector<ProbeTarget> smb_targets(const std::vector<MdnsRecord>& records) {
+    std::set<std::pair<std::string, int>> seen;
+    std::vector<ProbeTarget> targets;
+    for (const auto& r : records) {
+        if (r.type == kSmbType && r.port > 0 && seen.insert({r.ip, r.port}).second) {
+            targets.push_back({r.ip, r.port});
+        }
+    }
+    return targets;
+}
+
+std::vector<ProbeTarget> without_advertised(const std::vector<ProbeTarget>& targets,
+                                            const std::vector<MdnsRecord>& records) {
+    std::set<std::pair<std::string, int>> advertised;
+    for (const auto& t : smb_targets(records)) {
+        advertised.insert({t.ip, t.port});
+    }
+    std::vector<ProbeTarget> rest;
+    for (const auto& t : targets) {
+        if (!advertised.count({t.ip, t.port})) rest.push_back(t);
+    }
+    return rest;
+}
+
+void apply_names(std::vector<DeviceInfo>& devices, const std::vector<MdnsRecord>& records) {
+    std::map<std::string, std::string> names;
+    for (const auto& r : records) {
+        std::string name = r.service_name.empty() ? r.host_name : r.service_name;
+        // _smb._tcp的实例名覆盖_device-info._tcp的
+        if (!name.empty() && (r.type == kSmbType || !names.count(r.ip))) {
+            names[r.ip] = name;
+        }
+    }
+    for (auto& d : devices) {
+        auto it = names.find(d.ip);
+        if (it != names.end()) d.name = it->second;
+    }
+}
+
+void add_advertised(std::vector<ProbeTarget>& open, const std::vector<MdnsRecord>& records) {
+    std::set<std::pair<std::string, int>> known;
+    for (const auto& t : open) {
+        known.insert({t.ip, t.port});
+    }
+    for (const auto& t : smb_targets(records)) {
+        if (known.insert({t.ip, t.port}).second) open.push_back(t);
+    }
+}
@@ -0,0 +1,302 @@
+// metrics.cpp
+#include "metrics.hpp"
+#include <json/json.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+const uint64_t OpSeries::kBoundsUs[OpSeries::kBuckets - 1] = {
+    50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000,
+};
+
+namespace {
+
+const char* const kOpNames[] = {
+    "acquire", "connect", "auth", "open", "opendir", "read", "write", "close",
+    "stat", "mkdir", "unlink", "truncate", "rename", "check", "list_shares", "download", "upload",
+};
+
+// Prometheus标签值转义：反斜杠、双引号和换行
+std::string escape_label(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string labels(const OpSeries& s) {
+    return "op=\"" + std::string(op_name(s.op())) + "\",server=\"" + escape_label(s.server()) +
+           "\",share=\"" + escape_label(s.share()) + "\"";
+}
+
+bool write_atomically(const std::string& path, const std::string& content) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << content;
+        if (!out.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+}  // namespace
+
+const char* op_name(SmbOp op) {
+    return kOpNames[static_cast<int>(op)];
+}
+
+OpSeries::OpSeries(Metrics* owner, SmbOp op, std::string server, std::string share)
+    : owner_(owner), op_(op), server_(std::move(server)), share_(std::move(share)) {
+    for (auto& b : buckets_) b.store(0, std::memory_order_relaxed);
+}
+
+void OpSeries::record(Clock::time_point start, uint64_t bytes, int error) {
+    // 调用方常在记录之后还要检查errno
+    int saved_errno = errno;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    uint64_t duration_ns = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    uint64_t us = duration_ns / 1000;
+
+    size_t bucket = 0;
+    while (bucket < kBuckets - 1 && us > kBoundsUs[bucket]) ++bucket;
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(duration_ns, std::memory_order_relaxed);
+    if (bytes) bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    if (error) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        ++errors_[error];
+    }
+    if (owner_->tracing()) {
+        owner_->add_span(*this, start, duration_ns, bytes, error);
+    }
+    errno = saved_errno;
+}
+
+Metrics& Metrics::global() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics() : epoch_(OpSeries::Clock::now()) {}
+
+OpSeries& Metrics::series(SmbOp op, const std::string& server, const std::string& share) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = series_[Key(static_cast<int>(op), server, share)];
+    if (!slot) {
+        slot.reset(new OpSeries(this, op, server, share));
+    }
+    return *slot;
+}
+
+void Metrics::add_retry(const std::string& server, const std::string& share) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++retries_[{server, share}];
+}
+
+void Metrics::enable_tracing(size_t capacity) {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    trace_capacity_ = std::max<size_t>(capacity, 1);
+    spans_.clear();
+    spans_.reserve(std::min<size_t>(trace_capacity_, 4096));
+    trace_next_ = 0;
+    tracing_.store(true, std::memory_order_relaxed);
+}
+
+void Metrics::add_span(const OpSeries& series, OpSeries::Clock::time_point start,
+                       uint64_t duration_ns, uint64_t bytes, int error) {
+    TraceSpan span;
+    span.op = series.op_;
+    span.server = series.server_;
+    span.share = series.share_;
+    span.thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+    span.start_us = std::chrono::duration_cast<std::chrono::microseconds>(start - epoch_).count();
+    span.duration_us = duration_ns / 1000;
+    span.bytes = bytes;
+    span.error = error;
+
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    if (spans_.size() < trace_capacity_) {
+        spans_.push_back(std::move(span));
+    } else {
+        spans_[trace_next_] = std::move(span);
+        trace_next_ = (trace_next_ + 1) % trace_capacity_;
+    }
+}
+
+std::vector<TraceSpan> Metrics::spans() const {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    // 环形缓冲区从最旧的一条开始输出
+    std::vector<TraceSpan> out(spans_.begin() + trace_next_, spans_.end());
+    out.insert(out.end(), spans_.begin(), spans_.begin() + trace_next_);
+    return out;
+}
+
+std::string Metrics::prometheus() const {
+    std::ostringstream out;
+    out.precision(12);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    out << "# HELP pcn_smb_op_duration_seconds SMB operation latency.\n"
+        << "# TYPE pcn_smb_op_duration_seconds histogram\n";
+    for (const auto& kv : series_) {
+        const OpSeries& s = *kv.second;
+        std::string l = labels(s);
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < OpSeries::kBuckets; ++i) {
+            cumulative += s.buckets_[i].load(std::memory_order_relaxed);
+            out << "pcn_smb_op_duration_seconds_bucket{" << l << ",le=\"";
+            if (i < OpSeries::kBuckets - 1) {
+                out << OpSeries::kBoundsUs[i] / 1e6;
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "pcn_smb_op_duration_seconds_sum{" << l << "} "
+            << s.sum_ns_.load(std::memory_order_relaxed) / 1e9 << "\n"
+            << "pcn_smb_op_duration_seconds_count{" << l << "} "
+            << s.count_.load(std::memory_order_relaxed) << "\n";
+    }
+
+    out << "# HELP pcn_smb_op_bytes_total Bytes moved by SMB operations.\n"
+        << "# TYPE pcn_smb_op_bytes_total counter\n";
+    for (const auto& kv : series_) {
+        uint64_t bytes = kv.second->bytes_.load(std::memory_order_relaxed);
+        if (bytes) {
+            out << "pcn_smb_op_bytes_total{" << labels(*kv.second) << "} " << bytes << "\n";
+        }
+    }
+
+    out << "# HELP pcn_smb_op_errors_total Failed SMB operations by errno.\n"
+        << "# TYPE pcn_smb_op_errors_total counter\n";
+    for (const auto& kv : series_) {
+        OpSeries& s = *kv.second;
+        std::lock_guard<std::mutex> error_lock(s.error_mutex_);
+        for (const auto& e : s.errors_) {
+            out << "pcn_smb_op_errors_total{" << labels(s) << ",errno=\"" << e.first << "\"} "
+                << e.second << "\n";
+        }
+    }
+
+    out << "# HELP pcn_transfer_retries_total Retried transfer jobs.\n"
+        << "# TYPE pcn_transfer_retries_total counter\n";
+    for (const auto& kv : retries_) {
+        out << "pcn_transfer_retries_total{server=\"" << escape_label(kv.first.first)
+            << "\",share=\"" << escape_label(kv.first.second) << "\"} " << kv.second << "\n";
+    }
+    return out.str();
+}
+
+std::string Metrics::json() const {
+    Json::Value root;
+    root["series"] = Json::Value(Json::arrayValue);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& kv : series_) {
+            OpSeries& s = *kv.second;
+            Json::Value v;
+            v["op"] = op_name(s.op_);
+            v["server"] = s.server_;
+            v["share"] = s.share_;
+            v["count"] = Json::UInt64(s.count_.load(std::memory_order_relaxed));
+            v["sum_seconds"] = s.sum_ns_.load(std::memory_order_relaxed) / 1e9;
+            v["bytes"] = Json::UInt64(s.bytes_.load(std::memory_order_relaxed));
+
+            Json::Value buckets(Json::arrayValue);
+            for (size_t i = 0; i < OpSeries::kBuckets; ++i) {
+                Json::Value b;
+                b["le_us"] = i < OpSeries::kBuckets - 1 ? Json::Value(Json::UInt64(OpSeries::kBoundsUs[i]))
+                                                        : Json::Value("+Inf");
+                b["count"] = Json::UInt64(s.buckets_[i].load(std::memory_order_relaxed));
+                buckets.append(b);
+            }
+            v["buckets"] = buckets;
+
+            Json::Value errors(Json::objectValue);
+            std::lock_guard<std::mutex> error_lock(s.error_mutex_);
+            for (const auto& e : s.errors_) {
+                errors[std::to_string(e.first)] = Json::UInt64(e.second);
+            }
+            v["errors"] = errors;
+            root["series"].append(v);
+        }
+
+        root["retries"] = Json::Value(Json::arrayValue);
+        for (const auto& kv : retries_) {
+            Json::Value r;
+            r["server"] = kv.first.first;
+            r["share"] = kv.first.second;
+            r["count"] = Json::UInt64(kv.second);
+            root["retries"].append(r);
+        }
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    return Json::writeString(builder, root) + "\n";
+}
+
+bool Metrics::write(const std::string& path) const {
+    bool as_json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    return write_atomically(path, as_json ? json() : prometheus());
+}
+
+bool Metrics::write_trace(const std::string& path) const {
+    Json::Value events(Json::arrayValue);
+    for (const auto& span : spans()) {
+        Json::Value e;
+        e["name"] = op_name(span.op);
+        e["cat"] = "smb";
+        e["ph"] = "X";
+        e["ts"] = Json::UInt64(span.start_us);
+        e["dur"] = Json::UInt64(span.duration_us);
+        e["pid"] = 1;
+        e["tid"] = Json::UInt64(span.thread % 100000);
+        e["args"]["server"] = span.server;
+        e["args"]["share"] = span.share;
+        if (span.bytes) e["args"]["bytes"] = Json::UInt64(span.bytes);
+        if (span.error) e["args"]["errno"] = span.error;
+        events.append(e);
+    }
+    Json::Value root;
+    root["traceEvents"] = events;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return write_atomically(path, Json::writeString(builder, root) + "\n");
+}
+
+void Metrics::reset() {
+    {
+        // 只清零不删除，其他线程可能还持有序列的引用
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& kv : series_) {
+            OpSeries& s = *kv.second;
+            for (auto& b : s.buckets_) b.store(0, std::memory_order_relaxed);
+            s.count_.store(0, std::memory_order_relaxed);
+            s.sum_ns_.store(0, std::memory_order_relaxed);
+            s.bytes_.store(0, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> error_lock(s.error_mutex_);
+            s.errors_.clear();
+        }
+        retries_.clear();
+    }
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    spans_.clear();
+    trace_next_ = 0;
+}
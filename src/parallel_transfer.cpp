@@ -0,0 +1,247 @@
+// parallel_transfer.cpp
+#include "parallel_transfer.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// 续传状态文件：头部(魔数、版本、文件大小、源文件mtime、分段大小、传输目标) + 每分段1位的位图。
+// 源文件大小不变但内容被修改时mtime不同，不会把新旧数据拼在一起
+class RangeState {
+public:
+    RangeState(const std::string& path, const std::string& target,
+               uint64_t size, int64_t mtime, uint64_t range_size)
+        : path_(path), target_(target), size_(size), mtime_(mtime), range_size_(range_size),
+          ranges_(range_size ? (size + range_size - 1) / range_size : 0),
+          bits_((ranges_ + 7) / 8, 0) {}
+
+    ~RangeState() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    // 读取已有状态，头部与本次传输不一致时返回false
+    bool load() {
+        fd_ = open(path_.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd_ < 0) return false;
+
+        std::string expected = header();
+        std::string actual(expected.size(), '\0');
+        if (pread(fd_, &actual[0], actual.size(), 0) != static_cast<ssize_t>(actual.size()) ||
+            actual != expected ||
+            pread(fd_, bits_.data(), bits_.size(), expected.size()) !=
+                static_cast<ssize_t>(bits_.size())) {
+            close(fd_);
+            fd_ = -1;
+            std::fill(bits_.begin(), bits_.end(), 0);
+            return false;
+        }
+        return true;
+    }
+
+    bool create() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) return false;
+
+        std::fill(bits_.begin(), bits_.end(), 0);
+        std::string data = header();
+        data.append(bits_.begin(), bits_.end());
+        return write(fd_, data.data(), data.size()) == static_cast<ssize_t>(data.size()) &&
+               fsync(fd_) == 0;
+    }
+
+    size_t count() const { return ranges_; }
+
+    bool done(size_t i) const { return bits_[i / 8] & (1u << (i % 8)); }
+
+    // 记录一个分段完成，只重写位图中对应的那个字节
+    bool mark(size_t i) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bits_[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+        return pwrite(fd_, &bits_[i / 8], 1, header_size() + i / 8) == 1;
+    }
+
+    void remove() {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        unlink(path_.c_str());
+    }
+
+private:
+    std::string header() const {
+        std::string h("PCNR", 4);
+        auto put = [&h](const void* p, size_t n) { h.append(static_cast<const char*>(p), n); };
+        uint32_t version = 2;
+        uint32_t target_len = static_cast<uint32_t>(target_.size());
+        put(&version, sizeof(version));
+        put(&size_, sizeof(size_));
+        put(&mtime_, sizeof(mtime_));
+        put(&range_size_, sizeof(range_size_));
+        put(&target_len, sizeof(target_len));
+        h += target_;
+        return h;
+    }
+
+    size_t header_size() const { return 4 + 4 + 8 + 8 + 8 + 4 + target_.size(); }
+
+    std::string path_;
+    std::string target_;
+    uint64_t size_;
+    int64_t mtime_;
+    uint64_t range_size_;
+    size_t ranges_;
+    std::vector<uint8_t> bits_;
+    int fd_ = -1;
+    std::mutex mutex_;
+};
+
+static std::string describe(const std::string& ip, int port, const std::string& share,
+                            const std::string& remote_path) {
+    return "smb://" + ip + ":" + std::to_string(port) + "/" + share + "/" + remote_path;
+}
+
+ParallelTransfer::ParallelTransfer(const ParallelOptions& options,
+                                   std::shared_ptr<SmbContextPool> pool)
+    : options_(options), pool_(pool ? std::move(pool) : std::make_shared<SmbContextPool>()) {
+    if (options_.range_size == 0) {
+        options_.range_size = ParallelOptions().range_size;
+    }
+}
+
+bool ParallelTransfer::download(const std::string& ip, const std::string& share,
+                                const std::string& remote_path, const std::string& local_path,
+                                int port) {
+    stats_ = TransferStats();
+    RemoteEntry remote;
+    {
+        SambaClient probe(pool_);
+        if (!probe.stat_remote(ip, share, remote_path, remote, port)) return false;
+    }
+    int64_t size = static_cast<int64_t>(remote.size);
+
+    RangeState state(local_path + ".pcnpart", "get " + describe(ip, port, share, remote_path),
+                     size, remote.mtime, options_.range_size);
+    struct stat st;
+    bool resumed = options_.resume && stat(local_path.c_str(), &st) == 0 &&
+                   st.st_size == size && state.load();
+
+    int fd = open(local_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (resumed ? 0 : O_TRUNC), 0644);
+    if (fd < 0) return false;
+
+    if (!resumed) {
+        // 预分配整个文件，各流用pwrite写入各自区间
+        if ((fallocate(fd, 0, 0, size) != 0 && ftruncate(fd, size) != 0) || !state.create()) {
+            close(fd);
+            return false;
+        }
+    }
+
+    bool success = run(ip, share, remote_path, port, fd, size, state, &SambaClient::read_range,
+                       true);
+    if (close(fd) != 0) success = false;
+    return success;
+}
+
+bool ParallelTransfer::upload(const std::string& ip, const std::string& share,
+                              const std::string& local_path, const std::string& remote_path,
+                              int port) {
+    stats_ = TransferStats();
+    int fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    RangeState state(local_path + ".pcnup", "put " + describe(ip, port, share, remote_path),
+                     st.st_size, mtime_ns, options_.range_size);
+    bool ok = true;
+    {
+        SambaClient probe(pool_);
+        bool resumed = options_.resume && state.load() &&
+                       probe.remote_size(ip, share, remote_path, port) == st.st_size;
+        if (!resumed) {
+            ok = probe.create_remote(ip, share, remote_path, st.st_size, port) && state.create();
+        }
+    }
+
+    if (ok) {
+        ok = run(ip, share, remote_path, port, fd, st.st_size, state, &SambaClient::write_range,
+                 false);
+    }
+    close(fd);
+    return ok;
+}
+
+bool ParallelTransfer::run(const std::string& ip, const std::string& share,
+                           const std::string& remote_path, int port, int local_fd,
+                           uint64_t size, RangeState& state, RangeFn fn, bool sync_local) {
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < state.count(); ++i) {
+        if (!state.done(i)) pending.push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{0};
+    std::atomic<bool> ok{true};
+    std::atomic<uint64_t> bytes{0};
+
+    auto worker = [&]() {
+        try {
+            SambaClient client(pool_);
+            TransferOptions transfer;
+            transfer.chunk_size = options_.chunk_size;
+            client.set_transfer_options(transfer);
+            TransferControl control;
+            control.flow = options_.flow;
+            client.set_control(control);
+
+            for (size_t k = next++; k < pending.size(); k = next++) {
+                size_t i = pending[k];
+                uint64_t offset = i * options_.range_size;
+                uint64_t length = std::min(options_.range_size, size - offset);
+                // 失败的分段留在位图中未完成，下次续传时重试
+                if (!(client.*fn)(ip, share, remote_path, local_fd, offset, length, port)) {
+                    ok = false;
+                    continue;
+                }
+                // 下载时数据落盘后再记录完成，保证位图不会领先于文件内容；
+                // 上传的远端数据在write_range关闭文件时已由服务器确认
+                if ((sync_local && fdatasync(local_fd) != 0) || !state.mark(i)) {
+                    ok = false;
+                    continue;
+                }
+                bytes += length;
+            }
+        } catch (...) {
+            ok = false;
+        }
+    };
+
+    size_t workers = std::min<size_t>(std::max(options_.streams, 1), pending.size());
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    stats_.bytes = bytes;
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (ok) {
+        state.remove();
+    }
+    return ok;
+}
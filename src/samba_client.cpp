@@ -1,144 +1,615 @@
 #include "samba_client.hpp"
+#include "discovery.hpp"
+#include "metrics.hpp"
+#include "bandwidth.hpp"
 #include <samba-4.0/libsmbclient.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
-static SMBCCTX* context = nullptr;
+SambaClient::SambaClient(std::shared_ptr<SmbContextPool> pool)
+    : pool(pool ? std::move(pool) : std::make_shared<SmbContextPool>()) {}
 
-static void auth_fn(const char* server, const char* share,
-                   char* workgroup, int wgmaxlen,
-                   char* username, int unmaxlen,
-                   char* password, int pwmaxlen) {
-    strncpy(username, "wjj", unmaxlen-1);
-    strncpy(password, "20030509a", pwmaxlen-1);
-    strncpy(workgroup, "WORKGROUP", wgmaxlen-1);
+// 连接级错误时丢弃上下文，下次借用会重新建立会话
+static void drop_if_broken(ContextLease& lease, int error) {
+    switch (error) {
+    case ECONNRESET:
+    case ECONNREFUSED:
+    case ECONNABORTED:
+    case ETIMEDOUT:
+    case EPIPE:
+    case ENOTCONN:
+    case EHOSTUNREACH:
+    case EIO:
+        lease.invalidate();
+        break;
+    default:
+        break;
+    }
+}
+
+// 新建上下文上的第一个请求包含连接和认证，单独计入connect
+static SmbOp first_op(const ContextLease& lease, SmbOp op) {
+    return lease.fresh() ? SmbOp::Connect : op;
 }
 
-SambaClient::SambaClient() {
-    context = smbc_new_context();
-    if (!context) {
-        throw std::runtime_error("Failed to create SMB context");
+bool SambaClient::begin(ContextLease& lease) {
+    // 借不到上下文只会是排队等待期间被取消或超时
+    int reason = control.stop_reason();
+    if (reason || !lease.get()) {
+        last_errno = reason ? reason : ETIMEDOUT;
+        return false;
     }
-    
-    smbc_setOptionUserData(context, this);
-    smbc_setFunctionAuthData(context, auth_fn);
-    
-    if (!smbc_init_context(context)) {
-        smbc_free_context(context, 1);
-        throw std::runtime_error("Failed to initialize SMB context");
+    // 有截止时间时，单个请求的超时不超过剩余时间，服务器卡住也能按时返回
+    long remaining = control.remaining_ms();
+    if (remaining >= 0) {
+        lease.limit_timeout(static_cast<int>(std::min<long>(remaining, INT32_MAX)));
     }
-    smbc_set_context(context);
+    return true;
 }
 
-SambaClient::~SambaClient() {
-    if (context) {
-        smbc_free_context(context, 1);
-    }
+// 每块写完后汇报进度并检查取消和截止时间
+static ChunkProgress progress_hook(const TransferControl& control, uint64_t total) {
+    return [&control, total](uint64_t bytes) {
+        if (control.progress) control.progress(bytes, total);
+        return control.stop_reason() == 0;
+    };
+}
+
+// 本次操作在公平调度中的流：调用方给了就共用，否则用操作自己的
+static TransferFlow& flow_of(const TransferControl& control, TransferFlow& own) {
+    return control.flow ? *control.flow : own;
+}
+
+void SambaClient::fail(ContextLease& lease, OpTimer& timer, int error) {
+    last_errno = error;
+    timer.fail(error);
+    drop_if_broken(lease, error);
 }
 
 bool SambaClient::check_samba(const std::string& ip, int port) {
-    std::string url = "smb://" + ip + ":" + std::to_string(port) + "/";
-    int fd = smbc_opendir(url.c_str());
-    if (fd >= 0) {
-        smbc_closedir(fd);
+    std::string server = server_label(ip, port);
+    OpTimer total(SmbOp::Check, server, "");
+    std::string url = "smb://" + server + "/";
+    ContextLease lease = pool->acquire(ip, port, "", control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) {
+        total.fail(last_errno);
+        return false;
+    }
+    OpTimer timer(first_op(lease, SmbOp::OpenDir), server, "");
+    SMBCFILE* dir = smbc_getFunctionOpendir(context)(context, url.c_str());
+    if (dir) {
+        smbc_getFunctionClosedir(context)(context, dir);
         return true;
     }
+    fail(lease, timer, errno);
+    total.fail(last_errno);
     return false;
 }
 
-// 新增函数：扫描所有可能的Samba端口
+// 扫描所有可能的Samba端口：先做非阻塞TCP探测，只对开放端口做SMB握手
 std::vector<int> SambaClient::find_samba_ports(const std::string& ip) {
-    std::vector<int> active_ports;
-    
-    // 先检查标准端口445
-    if (this->check_samba(ip, 445)) {
-        active_ports.push_back(445);
-    }
-    
-    // 检查4455-4464端口范围
+    std::vector<ProbeTarget> targets = {{ip, 445}};
     for (int port = 4455; port <= 4464; ++port) {
-        if (check_samba(ip, port)) {
-            active_ports.push_back(port);
+        targets.push_back({ip, port});
+    }
+
+    std::vector<int> active_ports;
+    DiscoveryOptions defaults;
+    for (const auto& t : probe_tcp(targets, defaults.connect_timeout_ms, defaults.max_inflight)) {
+        if (check_samba(ip, t.port)) {
+            active_ports.push_back(t.port);
         }
     }
-    
+
     return active_ports;
 }
 
 std::vector<SambaShare> SambaClient::list_shares(const std::string& ip, int port) {
     std::vector<SambaShare> shares;
-    std::string url = "smb://" + ip + ":" + std::to_string(port) + "/";
-    
-    int fd = smbc_opendir(url.c_str());
-    if (fd < 0) return shares;
-    
-    smbc_dirent* dir;
-    while ((dir = smbc_readdir(fd)) != nullptr) {
-        if (dir->name[0] != '.') {
+    std::string server = server_label(ip, port);
+    OpTimer total(SmbOp::ListShares, server, "");
+    std::string url = "smb://" + server + "/";
+    ContextLease lease = pool->acquire(ip, port, "", control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) {
+        total.fail(last_errno);
+        return shares;
+    }
+
+    SMBCFILE* dir;
+    {
+        OpTimer timer(first_op(lease, SmbOp::OpenDir), server, "");
+        dir = smbc_getFunctionOpendir(context)(context, url.c_str());
+        if (!dir) {
+            fail(lease, timer, errno);
+            total.fail(last_errno);
+            return shares;
+        }
+    }
+
+    smbc_readdir_fn readdir_fn = smbc_getFunctionReaddir(context);
+    smbc_dirent* ent;
+    while ((ent = readdir_fn(context, dir)) != nullptr) {
+        if (ent->name[0] != '.') {
             SambaShare share;
-            share.name = dir->name;
+            share.name = ent->name;
             share.path = url + share.name;
             shares.push_back(share);
         }
     }
-    
-    smbc_closedir(fd);
+
+    smbc_getFunctionClosedir(context)(context, dir);
     return shares;
 }
 
+static std::string smb_url(const std::string& ip, int port, const std::string& share,
+                           const std::string& path) {
+    return "smb://" + ip + ":" + std::to_string(port) + "/" + share + "/" + path;
+}
+
+// 小文件一次读完，不值得起双缓冲线程和分配整块缓冲
+static void fit_to_size(TransferOptions& options, off_t size) {
+    if (size >= 0 && static_cast<uint64_t>(size) < options.chunk_size) {
+        options.pipelined = false;
+        options.chunk_size = static_cast<size_t>(size) + 1;
+    }
+}
+
 bool SambaClient::download(const std::string& ip, const std::string& share,
-                          const std::string& remote_path, const std::string& local_path) {
-    std::string src = "smb://" + ip + "/" + share + "/" + remote_path;
-    int src_fd = smbc_open(src.c_str(), O_RDONLY, 0);
-    if (src_fd < 0) return false;
-    
-    int dst_fd = open(local_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                          const std::string& remote_path, const std::string& local_path,
+                          int port) {
+    std::string server = server_label(ip, port);
+    OpTimer total(SmbOp::Download, server, share);
+    std::string src = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) {
+        total.fail(last_errno);
+        return false;
+    }
+    SMBCFILE* src_file;
+    {
+        OpTimer timer(first_op(lease, SmbOp::Open), server, share);
+        src_file = smbc_getFunctionOpen(context)(context, src.c_str(), O_RDONLY, 0);
+        if (!src_file) {
+            fail(lease, timer, errno);
+            total.fail(last_errno);
+            return false;
+        }
+    }
+
+    int dst_fd = open(local_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
     if (dst_fd < 0) {
-        smbc_close(src_fd);
+        last_errno = errno;
+        total.fail(last_errno);
+        smbc_getFunctionClose(context)(context, src_file);
         return false;
     }
-    
-    char buf[1024];
-    ssize_t n;
-    bool success = true;
-    
-    while ((n = smbc_read(src_fd, buf, sizeof(buf))) > 0){
-        if (write(dst_fd, buf, n) != n) {
-            success = false;
-            break;
+
+    // 按远端大小预分配本地空间，失败(如文件系统不支持)不影响传输
+    TransferOptions options = transfer_options;
+    uint64_t total_size = 0;
+    struct stat st;
+    if (smbc_getFunctionFstat(context)(context, src_file, &st) == 0) {
+        total_size = st.st_size;
+        if (st.st_size > 0) {
+            fallocate(dst_fd, FALLOC_FL_KEEP_SIZE, 0, st.st_size);
         }
+        fit_to_size(options, st.st_size);
     }
-    
-    close(dst_fd);
-    smbc_close(src_fd);
+
+    // 双缓冲时读在后台线程，SMB错误码单独保存，不依赖调用线程的errno
+    smbc_read_fn read_fn = smbc_getFunctionRead(context);
+    OpSeries& reads = Metrics::global().series(SmbOp::Read, server, share);
+    std::atomic<int> smb_error{0};
+    TransferFlow own_flow;
+    TransferFlow& flow = flow_of(control, own_flow);
+    ChunkReader reader = [&](char* buf, size_t len) {
+        auto start = OpSeries::Clock::now();
+        ssize_t n = read_fn(context, src_file, buf, len);
+        if (n < 0) smb_error = errno;
+        reads.record(start, n > 0 ? n : 0, n < 0 ? errno : 0);
+        // 先读后扣令牌，限速时在这里等待；被取消时stop_reason给出原因
+        if (n > 0 && BandwidthLimiter::global().consume(server, flow, n, control) != 0) {
+            return ssize_t(-1);
+        }
+        return n;
+    };
+    ChunkWriter writer = [&](const char* buf, size_t len) {
+        return write(dst_fd, buf, len);
+    };
+    bool success = copy_stream(reader, writer, options, last_stats,
+                               progress_hook(control, total_size));
+    total.add_bytes(last_stats.bytes);
+
+    if (!success) {
+        int reason = control.stop_reason();
+        last_errno = smb_error ? smb_error.load() : reason ? reason : errno;
+        total.fail(last_errno);
+        drop_if_broken(lease, smb_error);
+    }
+    // 本地close报错(如延迟写回失败)说明文件不完整；这是本地错误，不丢弃SMB上下文
+    if (close(dst_fd) != 0 && success) {
+        last_errno = errno;
+        total.fail(last_errno);
+        success = false;
+    }
+    OpTimer timer(SmbOp::Close, server, share);
+    smbc_getFunctionClose(context)(context, src_file);
     return success;
 }
 
 bool SambaClient::upload(const std::string& ip, const std::string& share,
-                        const std::string& local_path, const std::string& remote_path) {
-    int src_fd = open(local_path.c_str(), O_RDONLY);
-    if (src_fd < 0) return false;
-    
-    std::string dst = "smb://" + ip + "/" + share + "/" + remote_path;
-    int dst_fd = smbc_open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (dst_fd < 0) {
+                        const std::string& local_path, const std::string& remote_path,
+                        int port) {
+    std::string server = server_label(ip, port);
+    OpTimer total(SmbOp::Upload, server, share);
+    int src_fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+        last_errno = errno;
+        total.fail(last_errno);
+        return false;
+    }
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    TransferOptions options = transfer_options;
+    uint64_t total_size = 0;
+    struct stat st;
+    if (fstat(src_fd, &st) == 0) {
+        total_size = st.st_size;
+        fit_to_size(options, st.st_size);
+    }
+
+    std::string dst = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) {
+        total.fail(last_errno);
         close(src_fd);
         return false;
     }
-    
-    char buf[1024];
-    ssize_t n;
-    bool success = true;
-    
-    while ((n = read(src_fd, buf, sizeof(buf))) > 0){
-        if (smbc_write(dst_fd, buf, n) != n) {
+    SMBCFILE* dst_file;
+    {
+        OpTimer timer(first_op(lease, SmbOp::Open), server, share);
+        dst_file = smbc_getFunctionOpen(context)(context, dst.c_str(),
+                                                 O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!dst_file) {
+            fail(lease, timer, errno);
+            total.fail(last_errno);
+            close(src_fd);
+            return false;
+        }
+    }
+
+    // 双缓冲时本地读在后台线程，读错误码与SMB错误码一样单独保存
+    smbc_write_fn write_fn = smbc_getFunctionWrite(context);
+    OpSeries& writes = Metrics::global().series(SmbOp::Write, server, share);
+    std::atomic<int> smb_error{0};
+    std::atomic<int> local_error{0};
+    TransferFlow own_flow;
+    TransferFlow& flow = flow_of(control, own_flow);
+    ChunkReader reader = [&](char* buf, size_t len) {
+        ssize_t n = read(src_fd, buf, len);
+        if (n < 0) local_error = errno;
+        return n;
+    };
+    ChunkWriter writer = [&](const char* buf, size_t len) {
+        auto start = OpSeries::Clock::now();
+        ssize_t n = write_fn(context, dst_file, buf, len);
+        if (n < 0) smb_error = errno;
+        writes.record(start, n > 0 ? n : 0, n < 0 ? errno : 0);
+        if (n > 0 && BandwidthLimiter::global().consume(server, flow, n, control) != 0) {
+            return ssize_t(-1);
+        }
+        return n;
+    };
+    bool success = copy_stream(reader, writer, options, last_stats,
+                               progress_hook(control, total_size));
+    total.add_bytes(last_stats.bytes);
+    if (!success) {
+        int reason = control.stop_reason();
+        last_errno = smb_error ? smb_error.load()
+                   : local_error ? local_error.load()
+                   : reason ? reason : errno;
+    }
+
+    {
+        // 关闭时服务器才确认写入，失败同样说明连接有问题
+        OpTimer timer(SmbOp::Close, server, share);
+        if (smbc_getFunctionClose(context)(context, dst_file) != 0) {
+            timer.fail(errno);
+            if (success) last_errno = errno;
+            smb_error = errno;
             success = false;
-            break;
         }
     }
-    
-    smbc_close(dst_fd);
+    if (!success) {
+        total.fail(last_errno);
+        drop_if_broken(lease, smb_error);
+    }
     close(src_fd);
     return success;
-}
\ No newline at end of file
+}
+
+int64_t SambaClient::remote_size(const std::string& ip, const std::string& share,
+                                 const std::string& remote_path, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return -1;
+    OpTimer timer(first_op(lease, SmbOp::Stat), server_label(ip, port), share);
+    struct stat st;
+    if (smbc_getFunctionStat(context)(context, url.c_str(), &st) != 0) {
+        fail(lease, timer, errno);
+        return -1;
+    }
+    return st.st_size;
+}
+
+bool SambaClient::create_remote(const std::string& ip, const std::string& share,
+                                const std::string& remote_path, int64_t size, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    std::string server = server_label(ip, port);
+    SMBCFILE* file;
+    {
+        OpTimer timer(first_op(lease, SmbOp::Open), server, share);
+        file = smbc_getFunctionOpen(context)(context, url.c_str(),
+                                             O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!file) {
+            fail(lease, timer, errno);
+            return false;
+        }
+    }
+    OpTimer timer(SmbOp::Truncate, server, share);
+    bool success = smbc_getFunctionFtruncate(context)(context, file, size) == 0;
+    if (smbc_getFunctionClose(context)(context, file) != 0) success = false;
+    if (!success) fail(lease, timer, errno);
+    return success;
+}
+
+bool SambaClient::read_range(const std::string& ip, const std::string& share,
+                             const std::string& remote_path, int local_fd,
+                             uint64_t offset, uint64_t length, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    std::string server = server_label(ip, port);
+    SMBCFILE* file;
+    {
+        OpTimer timer(first_op(lease, SmbOp::Open), server, share);
+        file = smbc_getFunctionOpen(context)(context, url.c_str(), O_RDONLY, 0);
+        if (!file) {
+            fail(lease, timer, errno);
+            return false;
+        }
+    }
+
+    bool success = smbc_getFunctionLseek(context)(context, file, offset, SEEK_SET) ==
+                   static_cast<off_t>(offset);
+    size_t chunk = std::min<uint64_t>(std::min(transfer_options.chunk_size, kMaxChunkSize), length);
+    std::unique_ptr<char[]> buf(new char[std::max<size_t>(chunk, 1)]);
+    smbc_read_fn read_fn = smbc_getFunctionRead(context);
+    OpSeries& reads = Metrics::global().series(SmbOp::Read, server, share);
+    BandwidthLimiter& limiter = BandwidthLimiter::global();
+    TransferFlow own_flow;
+    TransferFlow& flow = flow_of(control, own_flow);
+    uint64_t done = 0;
+    int error = success ? 0 : errno;
+
+    while (success && done < length) {
+        if ((error = control.stop_reason()) != 0) {
+            success = false;
+            break;
+        }
+        auto start = OpSeries::Clock::now();
+        ssize_t n = read_fn(context, file, buf.get(), std::min<uint64_t>(chunk, length - done));
+        if (n <= 0) {
+            error = n < 0 ? errno : ENODATA;  // 提前EOF说明远端文件被截断
+            reads.record(start, 0, error);
+            success = false;
+            break;
+        }
+        reads.record(start, n);
+        if ((error = limiter.consume(server, flow, n, control)) != 0) {
+            success = false;
+            break;
+        }
+        for (ssize_t w = 0; w < n;) {
+            ssize_t m = pwrite(local_fd, buf.get() + w, n - w, offset + done + w);
+            if (m <= 0) {
+                error = errno;
+                success = false;
+                break;
+            }
+            w += m;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+
+    if (!success) {
+        last_errno = error;
+        drop_if_broken(lease, error);
+    }
+    OpTimer timer(SmbOp::Close, server, share);
+    smbc_getFunctionClose(context)(context, file);
+    return success;
+}
+
+bool SambaClient::write_range(const std::string& ip, const std::string& share,
+                              const std::string& remote_path, int local_fd,
+                              uint64_t offset, uint64_t length, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    std::string server = server_label(ip, port);
+    SMBCFILE* file;
+    {
+        OpTimer timer(first_op(lease, SmbOp::Open), server, share);
+        file = smbc_getFunctionOpen(context)(context, url.c_str(), O_WRONLY, 0);
+        if (!file) {
+            fail(lease, timer, errno);
+            return false;
+        }
+    }
+
+    bool success = smbc_getFunctionLseek(context)(context, file, offset, SEEK_SET) ==
+                   static_cast<off_t>(offset);
+    size_t chunk = std::min<uint64_t>(std::min(transfer_options.chunk_size, kMaxChunkSize), length);
+    std::unique_ptr<char[]> buf(new char[std::max<size_t>(chunk, 1)]);
+    smbc_write_fn write_fn = smbc_getFunctionWrite(context);
+    OpSeries& writes = Metrics::global().series(SmbOp::Write, server, share);
+    BandwidthLimiter& limiter = BandwidthLimiter::global();
+    TransferFlow own_flow;
+    TransferFlow& flow = flow_of(control, own_flow);
+    uint64_t done = 0;
+    int error = success ? 0 : errno;
+
+    while (success && done < length) {
+        if ((error = control.stop_reason()) != 0) {
+            success = false;
+            break;
+        }
+        ssize_t n = pread(local_fd, buf.get(), std::min<uint64_t>(chunk, length - done),
+                          offset + done);
+        if (n <= 0) {
+            error = n < 0 ? errno : ENODATA;
+            success = false;
+            break;
+        }
+        for (ssize_t w = 0; w < n;) {
+            auto start = OpSeries::Clock::now();
+            ssize_t m = write_fn(context, file, buf.get() + w, n - w);
+            if (m <= 0) {
+                error = m < 0 ? errno : EIO;
+                writes.record(start, 0, error);
+                success = false;
+                break;
+            }
+            writes.record(start, m);
+            w += m;
+        }
+        if (success && (error = limiter.consume(server, flow, n, control)) != 0) {
+            success = false;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+
+    {
+        OpTimer timer(SmbOp::Close, server, share);
+        if (smbc_getFunctionClose(context)(context, file) != 0) {
+            timer.fail(errno);
+            if (success) error = errno;
+            success = false;
+        }
+    }
+    if (!success) {
+        last_errno = error;
+        drop_if_broken(lease, error);
+    }
+    return success;
+}
+
+bool SambaClient::list_dir(const std::string& ip, const std::string& share,
+                           const std::string& remote_dir, std::vector<RemoteEntry>& entries,
+                           int port) {
+    std::string url = smb_url(ip, port, share, remote_dir);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    OpTimer timer(first_op(lease, SmbOp::OpenDir), server_label(ip, port), share);
+    SMBCFILE* dir = smbc_getFunctionOpendir(context)(context, url.c_str());
+    if (!dir) {
+        fail(lease, timer, errno);
+        return false;
+    }
+
+    smbc_readdirplus_fn readdir_fn = smbc_getFunctionReaddirPlus(context);
+    const libsmb_file_info* info;
+    while ((info = readdir_fn(context, dir)) != nullptr) {
+        if (strcmp(info->name, ".") == 0 || strcmp(info->name, "..") == 0) continue;
+        RemoteEntry entry;
+        entry.name = info->name;
+        entry.is_dir = info->attrs & 0x10;  // FILE_ATTRIBUTE_DIRECTORY
+        entry.size = info->size;
+        entry.mtime = info->mtime_ts.tv_sec;
+        entries.push_back(entry);
+    }
+
+    smbc_getFunctionClosedir(context)(context, dir);
+    return true;
+}
+
+bool SambaClient::stat_remote(const std::string& ip, const std::string& share,
+                              const std::string& remote_path, RemoteEntry& entry, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    OpTimer timer(first_op(lease, SmbOp::Stat), server_label(ip, port), share);
+    struct stat st;
+    if (smbc_getFunctionStat(context)(context, url.c_str(), &st) != 0) {
+        fail(lease, timer, errno);
+        return false;
+    }
+    size_t slash = remote_path.rfind('/');
+    entry.name = slash == std::string::npos ? remote_path : remote_path.substr(slash + 1);
+    entry.is_dir = S_ISDIR(st.st_mode);
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    return true;
+}
+
+bool SambaClient::make_dir(const std::string& ip, const std::string& share,
+                           const std::string& remote_dir, int port) {
+    std::string url = smb_url(ip, port, share, remote_dir);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    OpTimer timer(first_op(lease, SmbOp::Mkdir), server_label(ip, port), share);
+    if (smbc_getFunctionMkdir(context)(context, url.c_str(), 0755) == 0 || errno == EEXIST) {
+        return true;
+    }
+    fail(lease, timer, errno);
+    return false;
+}
+
+bool SambaClient::remove_remote(const std::string& ip, const std::string& share,
+                                const std::string& remote_path, int port) {
+    std::string url = smb_url(ip, port, share, remote_path);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    OpTimer timer(first_op(lease, SmbOp::Unlink), server_label(ip, port), share);
+    if (smbc_getFunctionUnlink(context)(context, url.c_str()) == 0) {
+        return true;
+    }
+    fail(lease, timer, errno);
+    return false;
+}
+
+bool SambaClient::rename_remote(const std::string& ip, const std::string& share,
+                                const std::string& from, const std::string& to, int port) {
+    std::string from_url = smb_url(ip, port, share, from);
+    std::string to_url = smb_url(ip, port, share, to);
+    ContextLease lease = pool->acquire(ip, port, share, control);
+    SMBCCTX* context = lease.get();
+    if (!begin(lease)) return false;
+    OpTimer timer(first_op(lease, SmbOp::Rename), server_label(ip, port), share);
+    if (smbc_getFunctionRename(context)(context, from_url.c_str(), context, to_url.c_str()) == 0) {
+        return true;
+    }
+    fail(lease, timer, errno);
+    return false;
+}
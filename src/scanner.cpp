@@ -1,29 +1,136 @@
 // scanner.cpp
 #include "scanner.hpp"
+#include "discovery.hpp"
+#include <pcap.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <net/route.h>
 #include <net/ethernet.h>
 #include <netinet/if_ether.h>
+#include <netpacket/packet.h>
+#include <ifaddrs.h>
+#include <poll.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kMaxSweepHosts = 65534;  // 最多扫描一个/16
+const size_t kEtherHeader = 14;
+const size_t kArpPacket = 28;
+
+// 按IP(主机字节序)去重并排序
+using DeviceMap = std::map<uint32_t, DeviceInfo>;
+
+std::string mac_to_string(const uint8_t* mac) {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buf;
+}
+
+uint32_t parse_ip(const std::string& ip) {
+    in_addr addr;
+    return inet_pton(AF_INET, ip.c_str(), &addr) == 1 ? ntohl(addr.s_addr) : 0;
+}
+
+// pcap回调：只取ARP回复中的发送方IP和MAC
+void on_packet(u_char* user, const pcap_pkthdr* hdr, const u_char* data) {
+    if (hdr->caplen < kEtherHeader + kArpPacket) return;
+    const u_char* arp = data + kEtherHeader;
+    if (((arp[6] << 8) | arp[7]) != ARPOP_REPLY) return;
+
+    uint32_t spa;
+    memcpy(&spa, arp + 14, 4);
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &spa, ip, sizeof(ip));
+
+    auto* found = reinterpret_cast<DeviceMap*>(user);
+    DeviceInfo& device = (*found)[ntohl(spa)];
+    device.ip = ip;
+    device.mac = mac_to_string(arp + 8);
+    device.name = "Unknown";
+}
+
+void apply_filter(pcap_t* p, const std::string& expr) {
+    bpf_program prog;
+    if (pcap_compile(p, &prog, expr.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+        throw std::runtime_error(std::string("pcap_compile: ") + pcap_geterr(p));
+    }
+    int rc = pcap_setfilter(p, &prog);
+    pcap_freecode(&prog);
+    if (rc != 0) {
+        throw std::runtime_error(std::string("pcap_setfilter: ") + pcap_geterr(p));
+    }
+}
+
+std::vector<DeviceInfo> to_vector(const DeviceMap& found) {
+    std::vector<DeviceInfo> devices;
+    for (const auto& kv : found) {
+        devices.push_back(kv.second);
+    }
+    return devices;
+}
+
+// 关闭套接字和pcap句柄，异常路径也不泄漏
+struct SweepHandles {
+    int sock = -1;
+    pcap_t* pcap = nullptr;
+
+    ~SweepHandles() {
+        if (sock >= 0) close(sock);
+        if (pcap) pcap_close(pcap);
+    }
+};
+
+}  // namespace
+
+NetworkScanner::NetworkScanner(const ArpScanOptions& options) : options_(options) {}
 
 std::vector<DeviceInfo> NetworkScanner::scan(int timeout_ms) {
-    // 简化实现：直接读取ARP缓存
+    DeviceMap merged;
+
+    std::string interface = options_.replay_file.empty() ? default_interface() : "";
+    if (!options_.replay_file.empty() || !interface.empty()) {
+        try {
+            for (auto& d : arp_scan(interface, timeout_ms)) {
+                merged[parse_ip(d.ip)] = d;
+            }
+        } catch (const std::runtime_error&) {
+            // 没有CAP_NET_RAW等情况，退回到只读ARP缓存
+        }
+    }
+
+    for (auto& d : read_arp_cache()) {
+        merged.emplace(parse_ip(d.ip), d);
+    }
+    return to_vector(merged);
+}
+
+std::vector<DeviceInfo> NetworkScanner::read_arp_cache() {
+    // 直接读取ARP缓存
     std::vector<DeviceInfo> devices;
     std::ifstream arp_file("/proc/net/arp");
-    
+
     if (arp_file) {
         std::string line;
         std::getline(arp_file, line); // 跳过标题行
-        
+
         while (std::getline(arp_file, line)) {
             DeviceInfo device;
             char ip[16], mac[18], dummy[256];
-            
-            if (sscanf(line.c_str(), "%15s %*s %*s %17s %255s", 
+
+            if (sscanf(line.c_str(), "%15s %*s %*s %17s %255s",
                       ip, mac, dummy) >= 2) {
                 device.ip = ip;
                 device.mac = mac;
@@ -32,6 +139,178 @@ std::vector<DeviceInfo> NetworkScanner::scan(int timeout_ms) {
             }
         }
     }
-    
+
     return devices;
-}
\ No newline at end of file
+}
+
+std::string NetworkScanner::default_interface() {
+    // 目标和掩码都为0的路由是默认路由，有多条时取metric最小的
+    std::ifstream routes("/proc/net/route");
+    std::string line, best;
+    long best_metric = -1;
+    std::getline(routes, line);  // 跳过标题行
+    while (std::getline(routes, line)) {
+        char iface[IFNAMSIZ + 1];
+        unsigned long dest, gateway, mask;
+        unsigned flags;
+        long refcnt, use, metric;
+        if (sscanf(line.c_str(), "%16s %lx %lx %x %ld %ld %ld %lx", iface, &dest, &gateway,
+                   &flags, &refcnt, &use, &metric, &mask) == 8 &&
+            dest == 0 && mask == 0 && (flags & RTF_UP) &&
+            (best_metric < 0 || metric < best_metric)) {
+            best = iface;
+            best_metric = metric;
+        }
+    }
+    if (!best.empty()) return best;
+
+    ifaddrs* list = nullptr;
+    if (getifaddrs(&list) != 0) return "";
+
+    std::string name;
+    for (ifaddrs* ifa = list; ifa; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET &&
+            (ifa->ifa_flags & IFF_UP) && !(ifa->ifa_flags & IFF_LOOPBACK)) {
+            name = ifa->ifa_name;
+            break;
+        }
+    }
+    freeifaddrs(list);
+    return name;
+}
+
+std::vector<DeviceInfo> NetworkScanner::replay(const std::string& file) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    SweepHandles h;
+    h.pcap = pcap_open_offline(file.c_str(), errbuf);
+    if (!h.pcap) {
+        throw std::runtime_error(std::string("pcap_open_offline: ") + errbuf);
+    }
+    apply_filter(h.pcap, "arp and arp[6:2] = 2");
+
+    DeviceMap found;
+    pcap_loop(h.pcap, -1, on_packet, reinterpret_cast<u_char*>(&found));
+    return to_vector(found);
+}
+
+std::vector<DeviceInfo> NetworkScanner::arp_scan(const std::string& interface, int timeout_ms) {
+    if (!options_.replay_file.empty()) {
+        return replay(options_.replay_file);
+    }
+
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::milliseconds(std::max(timeout_ms, 1));
+    sweep_ = ArpSweepStats();
+    SweepHandles h;
+
+    // 接口的索引、MAC、IPv4地址和掩码
+    h.sock = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ARP));
+    if (h.sock < 0) {
+        throw std::runtime_error("Failed to open raw socket (requires CAP_NET_RAW)");
+    }
+    ifreq ifr{};
+    strncpy(ifr.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(h.sock, SIOCGIFINDEX, &ifr) != 0) {
+        throw std::runtime_error("Unknown interface: " + interface);
+    }
+    int ifindex = ifr.ifr_ifindex;
+    if (ioctl(h.sock, SIOCGIFHWADDR, &ifr) != 0) {
+        throw std::runtime_error("Cannot read MAC of " + interface);
+    }
+    uint8_t own_mac[6];
+    memcpy(own_mac, ifr.ifr_hwaddr.sa_data, 6);
+    if (ioctl(h.sock, SIOCGIFADDR, &ifr) != 0) {
+        throw std::runtime_error("No IPv4 address on " + interface);
+    }
+    uint32_t own_ip = ntohl(reinterpret_cast<sockaddr_in*>(&ifr.ifr_addr)->sin_addr.s_addr);
+    if (ioctl(h.sock, SIOCGIFNETMASK, &ifr) != 0) {
+        throw std::runtime_error("Cannot read netmask of " + interface);
+    }
+    uint32_t mask = ntohl(reinterpret_cast<sockaddr_in*>(&ifr.ifr_netmask)->sin_addr.s_addr);
+
+    // 目标地址：指定网段，或接口所在网段去掉网络地址和广播地址。
+    // 只按数值范围生成到kMaxSweepHosts为止，大网段不会先展开全部地址
+    uint64_t first = (own_ip & mask) + 1;
+    uint64_t last = (own_ip | ~mask) - 1;
+    if (!options_.subnet.empty()) {
+        uint32_t f = 0;
+        uint32_t l = 0;
+        cidr_range(options_.subnet, f, l);
+        first = f;
+        last = l;
+    }
+    sweep_.targets = last >= first ? last - first + 1 : 0;
+    if (own_ip >= first && own_ip <= last) --sweep_.targets;
+    std::vector<uint32_t> targets;
+    for (uint64_t a = first; a <= last && targets.size() < kMaxSweepHosts; ++a) {
+        if (a != own_ip) targets.push_back(static_cast<uint32_t>(a));
+    }
+
+    // 先开始抓包再发送，避免丢失最早的回复
+    char errbuf[PCAP_ERRBUF_SIZE];
+    h.pcap = pcap_create(interface.c_str(), errbuf);
+    if (!h.pcap) {
+        throw std::runtime_error(std::string("pcap_create: ") + errbuf);
+    }
+    pcap_set_snaplen(h.pcap, 64);
+    pcap_set_promisc(h.pcap, 0);
+    pcap_set_immediate_mode(h.pcap, 1);
+    if (pcap_activate(h.pcap) < 0) {
+        throw std::runtime_error(std::string("pcap_activate: ") + pcap_geterr(h.pcap));
+    }
+    apply_filter(h.pcap, "arp and arp[6:2] = 2 and ether dst " + mac_to_string(own_mac));
+    pcap_setnonblock(h.pcap, 1, errbuf);
+    int pcap_fd = pcap_get_selectable_fd(h.pcap);
+
+    // 广播ARP请求模板，每次只改目标IP
+    uint8_t frame[kEtherHeader + kArpPacket];
+    memset(frame, 0xff, 6);
+    memcpy(frame + 6, own_mac, 6);
+    frame[12] = ETH_P_ARP >> 8;
+    frame[13] = ETH_P_ARP & 0xff;
+    uint8_t* arp = frame + kEtherHeader;
+    const uint8_t arp_header[8] = {0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, ARPOP_REQUEST};
+    memcpy(arp, arp_header, 8);
+    memcpy(arp + 8, own_mac, 6);
+    uint32_t spa = htonl(own_ip);
+    memcpy(arp + 14, &spa, 4);
+    memset(arp + 18, 0, 6);
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ARP);
+    addr.sll_ifindex = ifindex;
+    addr.sll_halen = 6;
+    memset(addr.sll_addr, 0xff, 6);
+
+    DeviceMap found;
+    auto drain = [&](int wait_ms) {
+        pollfd pfd = {pcap_fd, POLLIN, 0};
+        if (poll(&pfd, 1, std::max(wait_ms, 0)) > 0) {
+            pcap_dispatch(h.pcap, -1, on_packet, reinterpret_cast<u_char*>(&found));
+        }
+    };
+
+    // 按速率分批发送：每轮补发到当前时刻应发的数量，间隙里收回复
+    const double rate = std::max(options_.rate_pps, 1);
+    size_t sent = 0;
+    while (sent < targets.size() && Clock::now() < deadline) {
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        size_t due = std::min(targets.size(), static_cast<size_t>(elapsed * rate) + 1);
+        for (; sent < due; ++sent) {
+            uint32_t tpa = htonl(targets[sent]);
+            memcpy(arp + 24, &tpa, 4);
+            sendto(h.sock, frame, sizeof(frame), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        }
+        drain(sent < targets.size() ? 1 : 0);
+    }
+    sweep_.sent = sent;
+
+    // 发送完后收集剩余回复，直到超时或所有目标都已回复
+    while (found.size() < targets.size()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0) break;
+        drain(static_cast<int>(left));
+    }
+    return to_vector(found);
+}
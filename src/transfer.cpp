@@ -0,0 +1,116 @@
+// transfer.cpp
+#include "transfer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// 短写时循环直到整块写完
+static bool write_all(const ChunkWriter& writer, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = writer(buf, len);
+        if (n <= 0) return false;
+        buf += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool copy_serial(const ChunkReader& reader, const ChunkWriter& writer,
+                        size_t chunk, uint64_t& bytes, const ChunkProgress& progress) {
+    std::unique_ptr<char[]> buf(new char[chunk]);
+    ssize_t n;
+    while ((n = reader(buf.get(), chunk)) > 0) {
+        if (!write_all(writer, buf.get(), static_cast<size_t>(n))) return false;
+        bytes += static_cast<uint64_t>(n);
+        if (progress && !progress(bytes)) return false;
+    }
+    return n == 0;
+}
+
+static bool copy_pipelined(const ChunkReader& reader, const ChunkWriter& writer,
+                           size_t chunk, uint64_t& bytes, const ChunkProgress& progress) {
+    struct Slot {
+        std::unique_ptr<char[]> data;
+        ssize_t len = 0;
+        bool full = false;
+    };
+    Slot slots[2];
+    for (auto& s : slots) {
+        s.data.reset(new char[chunk]);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool aborted = false;
+
+    // 生产者：读入空闲缓冲，读到EOF或出错后放入一个len<=0的结束标记
+    std::thread producer([&]() {
+        for (int i = 0;; i ^= 1) {
+            Slot& s = slots[i];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !s.full || aborted; });
+                if (aborted) return;
+            }
+            ssize_t n = reader(s.data.get(), chunk);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                s.len = n;
+                s.full = true;
+            }
+            cv.notify_all();
+            if (n <= 0) return;
+        }
+    });
+
+    bool success = true;
+    for (int i = 0;; i ^= 1) {
+        Slot& s = slots[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return s.full; });
+        }
+        if (s.len <= 0) {
+            success = s.len == 0;
+            break;
+        }
+        if (!write_all(writer, s.data.get(), static_cast<size_t>(s.len))) {
+            success = false;
+            break;
+        }
+        bytes += static_cast<uint64_t>(s.len);
+        if (progress && !progress(bytes)) {
+            success = false;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s.full = false;
+        }
+        cv.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+    }
+    cv.notify_all();
+    producer.join();
+    return success;
+}
+
+bool copy_stream(const ChunkReader& reader, const ChunkWriter& writer,
+                 const TransferOptions& options, TransferStats& stats,
+                 const ChunkProgress& progress) {
+    size_t chunk = std::min(std::max<size_t>(options.chunk_size, 4096), kMaxChunkSize);
+
+    stats = TransferStats();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = options.pipelined ? copy_pipelined(reader, writer, chunk, stats.bytes, progress)
+                                : copy_serial(reader, writer, chunk, stats.bytes, progress);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
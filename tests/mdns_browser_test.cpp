@@ -0,0 +1,162 @@
+// mdns_browser_test.cpp
+// 用桩后端测试MdnsBrowser的浏览窗口、流式回调和记录合并，不依赖avahi-daemon
+#include "mdns_browser.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+MdnsRecord record(const char* type, const char* name, const char* ip, int port) {
+    MdnsRecord r;
+    r.type = type;
+    r.service_name = name;
+    r.ip = ip;
+    r.port = port;
+    return r;
+}
+
+// 桩后端：start()后在自己的线程里按预定延迟逐条产生记录，stop()后不再产生
+class StubBackend : public MdnsBackend {
+public:
+    struct Scheduled {
+        int delay_ms;
+        MdnsRecord record;
+    };
+
+    explicit StubBackend(std::vector<Scheduled> plan) : plan_(std::move(plan)) {}
+    ~StubBackend() override { stop(); }
+
+    void start(const std::vector<std::string>& types, Callback callback) override {
+        stop();
+        types_ = types;
+        stopping_ = false;
+        ++starts_;
+        thread_ = std::thread([this, callback]() {
+            auto start = Clock::now();
+            for (const auto& s : plan_) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (cv_.wait_until(lock, start + std::chrono::milliseconds(s.delay_ms),
+                                   [this] { return stopping_; })) {
+                    return;
+                }
+                lock.unlock();
+                callback(s.record);
+            }
+        });
+    }
+
+    void stop() override {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        ++stops_;
+    }
+
+    std::vector<std::string> types_;
+    std::atomic<int> starts_{0};
+    std::atomic<int> stops_{0};
+
+private:
+    std::vector<Scheduled> plan_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+void test_window() {
+    auto* backend = new StubBackend({
+        {0, record("_smb._tcp", "NAS", "10.0.0.2", 445)},
+        {50, record("_device-info._tcp", "nas-info", "10.0.0.2", 0)},
+        {100, record("_smb._tcp", "PC", "10.0.0.3", 4455)},
+        {2000, record("_smb._tcp", "LATE", "10.0.0.9", 445)},
+    });
+    MdnsBrowser browser{std::unique_ptr<MdnsBackend>(backend)};
+
+    std::atomic<int> streamed{0};
+    browser.start([&streamed](const MdnsRecord&) { ++streamed; });
+    check(backend->types_.size() == 2, "browses _smb._tcp and _device-info._tcp");
+
+    // 其他工作很快结束，wait仍然等满窗口
+    auto t0 = Clock::now();
+    std::vector<MdnsRecord> records = browser.wait(300);
+    auto waited = Clock::now() - t0;
+    check(waited >= std::chrono::milliseconds(250), "wait() covers the browse window");
+    check(waited < std::chrono::milliseconds(1500), "wait() stops at the window");
+    check(records.size() == 3, "records inside the window are kept");
+    check(streamed == 3, "callback sees every record as it arrives");
+    check(backend->stops_ == 1, "wait() stops the backend");
+
+    // 窗口已过时立即返回
+    t0 = Clock::now();
+    browser.wait(300);
+    check(Clock::now() - t0 < std::chrono::milliseconds(50), "second wait() returns at once");
+}
+
+void test_browse() {
+    auto* backend = new StubBackend({{10, record("_smb._tcp", "A", "10.0.0.4", 445)}});
+    MdnsBrowser browser{std::unique_ptr<MdnsBackend>(backend)};
+    check(browser.browse(100).size() == 1, "browse() returns records from the window");
+    check(backend->starts_ == 1 && backend->stops_ == 1, "browse() starts and stops once");
+}
+
+void test_merge_helpers() {
+    std::vector<MdnsRecord> records = {
+        record("_smb._tcp", "NAS", "10.0.0.2", 445),
+        record("_smb._tcp", "NAS", "10.0.0.2", 445),
+        record("_device-info._tcp", "nas-info", "10.0.0.2", 0),
+        record("_device-info._tcp", "printer", "10.0.0.7", 0),
+        record("_smb._tcp", "PC", "10.0.0.3", 4455),
+    };
+
+    std::vector<ProbeTarget> smb = smb_targets(records);
+    check(smb.size() == 2, "smb_targets dedups and ignores _device-info");
+
+    std::vector<ProbeTarget> targets = {
+        {"10.0.0.2", 445}, {"10.0.0.2", 4455}, {"10.0.0.3", 4455}, {"10.0.0.5", 445}};
+    std::vector<ProbeTarget> rest = without_advertised(targets, records);
+    check(rest.size() == 2 && rest[0].port == 4455 && rest[1].ip == "10.0.0.5",
+          "without_advertised drops only advertised ip:port");
+
+    std::vector<DeviceInfo> devices = {
+        {"Unknown", "10.0.0.2", ""}, {"Unknown", "10.0.0.7", ""}, {"Unknown", "10.0.0.8", ""}};
+    apply_names(devices, records);
+    check(devices[0].name == "NAS", "_smb._tcp name wins over _device-info");
+    check(devices[1].name == "printer", "_device-info name used when no _smb._tcp");
+    check(devices[2].name == "Unknown", "unadvertised device keeps its name");
+
+    // 探测已开放的目标不重复加入，广播的其他目标追加在后
+    std::vector<ProbeTarget> open = {{"10.0.0.2", 445}, {"10.0.0.5", 445}};
+    add_advertised(open, records);
+    check(open.size() == 3 && open[2].ip == "10.0.0.3" && open[2].port == 4455,
+          "add_advertised merges without duplicates");
+}
+
+}  // namespace
+
+int main() {
+    test_window();
+    test_browse();
+    test_merge_helpers();
+    if (failures == 0) std::printf("mdns_browser_test: all passed\n");
+    return failures == 0 ? 0 : 1;
+}